@@ -0,0 +1,79 @@
+#include "buffer.h"
+#include <algorithm>
+#include <cerrno>
+
+void OutputBuffer::append(const char* data, size_t len) {
+    pending += len;
+
+    while (len > 0) {
+        if (blocks.empty() || blocks.back().shared || blocks.back().owned.size() == BLOCK_SIZE) {
+            blocks.emplace_back();
+            blocks.back().owned.reserve(BLOCK_SIZE);
+        }
+
+        std::string& tail = blocks.back().owned;
+        size_t n = std::min(len, BLOCK_SIZE - tail.size());
+        tail.append(data, n);
+        data += n;
+        len -= n;
+    }
+}
+
+void OutputBuffer::append(const std::shared_ptr<const std::string>& segment) {
+    if (segment->size() < SHARE_MIN) {
+        append(segment->data(), segment->size());
+        return;
+    }
+
+    blocks.emplace_back();
+    blocks.back().shared = segment;
+    pending += segment->size();
+}
+
+int OutputBuffer::fillIovecs(struct iovec* iov, int max) const {
+    int count = 0;
+    size_t offset = head_offset;
+
+    for (auto it = blocks.begin(); it != blocks.end() && count < max; ++it) {
+        iov[count].iov_base = const_cast<char*>(it->data()) + offset;
+        iov[count].iov_len = it->size() - offset;
+        offset = 0;
+        ++count;
+    }
+    return count;
+}
+
+void OutputBuffer::consume(size_t n) {
+    pending -= n;
+
+    while (n > 0) {
+        size_t available = blocks.front().size() - head_offset;
+        if (n < available) {
+            head_offset += n;
+            return;
+        }
+        n -= available;
+        blocks.pop_front();
+        head_offset = 0;
+    }
+}
+
+ssize_t OutputBuffer::writeTo(int fd) {
+    constexpr int MAX_IOV = 64;
+    ssize_t total = 0;
+
+    while (!empty()) {
+        struct iovec iov[MAX_IOV];
+        int count = fillIovecs(iov, MAX_IOV);
+
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        consume(static_cast<size_t>(n));
+        total += n;
+    }
+    return total;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <memory>
+#include <cstddef>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Chained reply buffer. Replies are appended into fixed-size blocks so a large
+// reply never needs one huge contiguous allocation, and whatever the socket
+// doesn't accept stays queued until it becomes writable again. Immutable
+// shared segments (such as an entry's cached encoding) can be chained in by
+// reference, so many clients can send the same bytes without copying them.
+class OutputBuffer {
+public:
+    static constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+    // Shared segments smaller than this are copied instead: a memcpy is
+    // cheaper than an extra iovec and block for a few dozen bytes
+    static constexpr size_t SHARE_MIN = 256;
+
+    OutputBuffer() : head_offset(0), pending(0) {}
+
+    void append(const char* data, size_t len);
+    void append(const std::string& s) { append(s.data(), s.size()); }
+    void append(const std::shared_ptr<const std::string>& segment);
+
+    // Bytes queued but not yet written
+    size_t size() const { return pending; }
+    bool empty() const { return pending == 0; }
+
+    // Describe up to max pending segments for writev; returns the count used
+    int fillIovecs(struct iovec* iov, int max) const;
+
+    // Drop n bytes from the front after they have been written
+    void consume(size_t n);
+
+    // Write as much as the socket accepts without blocking. Returns bytes
+    // written (0 if the socket is full) or -1 on a fatal socket error.
+    ssize_t writeTo(int fd);
+
+private:
+    // Either owned bytes appended in place, or a referenced shared segment
+    struct Block {
+        std::string owned;
+        std::shared_ptr<const std::string> shared;
+
+        const char* data() const { return shared ? shared->data() : owned.data(); }
+        size_t size() const { return shared ? shared->size() : owned.size(); }
+    };
+
+    std::deque<Block> blocks;
+    size_t head_offset;  // Bytes of blocks.front() already written
+    size_t pending;
+};
@@ -0,0 +1,245 @@
+#include "capture.h"
+#include <iostream>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::atomic<bool> capture_enabled(false);
+
+// The writer wakes at least this often, and early once this much is pending
+constexpr auto CAPTURE_FLUSH_INTERVAL = std::chrono::milliseconds(100);
+constexpr size_t CAPTURE_FLUSH_BYTES = 1024 * 1024;
+
+// One capture at a time. control_mutex serializes start/stop; buffer_mutex
+// guards the pending bytes shared by the event loops and the current writer.
+static std::mutex control_mutex;
+static std::string capture_dir;  // Absolute; empty until set, meaning the working directory
+static std::string capture_name;
+static std::thread writer_thread;
+
+// A writer thread's own state. Once stopped it is handed the rest of the
+// pending bytes, so a new capture can start while it finishes writing.
+struct CaptureWriter {
+    int fd;
+    bool stopping;
+    std::string last_batch;
+};
+
+static std::mutex buffer_mutex;
+static std::condition_variable buffer_cv;
+static CaptureWriter* writer = nullptr;  // The running capture's, if any
+static std::string pending;
+static uint64_t dropped = 0;
+static std::chrono::steady_clock::time_point last_record;
+
+static void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool writeAll(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static void writerLoop(CaptureWriter* w) {
+    bool failed = false;
+    while (true) {
+        std::string batch;
+        bool done;
+        {
+            std::unique_lock<std::mutex> lock(buffer_mutex);
+            buffer_cv.wait_for(lock, CAPTURE_FLUSH_INTERVAL,
+                               [w] { return w->stopping || pending.size() >= CAPTURE_FLUSH_BYTES; });
+            done = w->stopping;
+            batch.swap(done ? w->last_batch : pending);
+        }
+
+        if (!failed && !batch.empty() && !writeAll(w->fd, batch)) {
+            std::cerr << "Capture write failed: " << std::strerror(errno) << "; capture stopped" << std::endl;
+            failed = true;
+            capture_enabled.store(false);
+        }
+        if (done) break;
+    }
+    close(w->fd);
+    delete w;
+}
+
+// Detach the running capture from the event loops and return its writer
+// thread, which exits once it has written what was captured; the caller
+// joins it without holding any lock
+static std::thread stopLocked() {
+    if (!writer_thread.joinable()) return std::thread();
+
+    uint64_t lost;
+    capture_enabled.store(false);
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex);
+        writer->stopping = true;
+        writer->last_batch.swap(pending);
+        pending.clear();
+        writer = nullptr;
+        lost = dropped;
+    }
+    buffer_cv.notify_all();
+
+    if (lost > 0) {
+        std::cerr << "Capture " << capture_name << " dropped " << lost
+                  << " records while the writer fell behind" << std::endl;
+    }
+    capture_name.clear();
+    return std::move(writer_thread);
+}
+
+static std::string absolutePath(const std::string& path) {
+    char resolved[PATH_MAX];
+    return realpath(path.c_str(), resolved) ? std::string(resolved) : std::string();
+}
+
+static const std::string& captureDirLocked() {
+    if (capture_dir.empty()) {
+        capture_dir = absolutePath(".");
+    }
+    return capture_dir;
+}
+
+bool setCaptureDir(const std::string& dir, std::string& err) {
+    std::lock_guard<std::mutex> control(control_mutex);
+    struct stat st;
+    std::string resolved = absolutePath(dir);
+    if (resolved.empty() || stat(resolved.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        err = "ERR Invalid argument '" + dir + "' for CONFIG SET 'capture-dir': not a directory";
+        return false;
+    }
+    if (writer_thread.joinable()) {
+        err = "ERR capture-dir must be set before capture-file";
+        return false;
+    }
+    capture_dir = resolved;
+    return true;
+}
+
+std::string captureDir() {
+    std::lock_guard<std::mutex> control(control_mutex);
+    return captureDirLocked();
+}
+
+bool setCaptureFile(const std::string& name, std::string& err) {
+    // Only a new file directly inside capture-dir, so clients can't reach
+    // (or truncate) anything else the server may write
+    if (!name.empty() && (name.find('/') != std::string::npos || name == "." || name == "..")) {
+        err = "ERR Invalid argument '" + name + "' for CONFIG SET 'capture-file': must be a file name in capture-dir";
+        return false;
+    }
+
+    std::thread old_writer;
+    bool ok = true;
+    {
+        std::lock_guard<std::mutex> control(control_mutex);
+        old_writer = stopLocked();
+        if (!name.empty()) {
+            std::string path = captureDirLocked() + "/" + name;
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                err = "ERR Can't create capture file '" + path + "': " + std::strerror(errno);
+                ok = false;
+            } else {
+                CaptureWriter* w = new CaptureWriter{fd, false, std::string()};
+                {
+                    std::lock_guard<std::mutex> lock(buffer_mutex);
+                    pending.assign(CAPTURE_MAGIC, CAPTURE_MAGIC_LEN);
+                    dropped = 0;
+                    last_record = std::chrono::steady_clock::now();
+                    writer = w;
+                }
+                capture_name = name;
+                writer_thread = std::thread(writerLoop, w);
+                capture_enabled.store(true);
+            }
+        }
+    }
+
+    // The stopped capture is complete on disk once this returns
+    if (old_writer.joinable()) {
+        old_writer.join();
+    }
+    return ok;
+}
+
+// Finish a capture still running when the process exits (a startup error
+// after --capture-file, say), so its thread is joined and its file complete
+static struct CaptureShutdown {
+    ~CaptureShutdown() {
+        std::string err;
+        setCaptureFile("", err);
+    }
+} capture_shutdown;
+
+std::string captureFile() {
+    std::lock_guard<std::mutex> control(control_mutex);
+    return capture_name;
+}
+
+// Stamp and queue a record whose client id, argc and arguments are in body
+static void appendRecord(const std::string& body) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex);
+        if (!writer) return;
+        if (pending.size() + body.size() > CAPTURE_BUFFER_MAX) {
+            dropped++;
+            return;
+        }
+
+        // Stamped under the lock so deltas are never negative
+        auto now = std::chrono::steady_clock::now();
+        putVarint(pending, std::chrono::duration_cast<std::chrono::microseconds>(now - last_record).count());
+        last_record = now;
+        pending += body;
+        wake = pending.size() >= CAPTURE_FLUSH_BYTES;
+    }
+    if (wake) {
+        buffer_cv.notify_all();
+    }
+}
+
+void captureCommand(uint64_t client_id, const std::vector<RESPValue>& args) {
+    // Encoded outside the lock, into a per-thread buffer that is reused
+    static thread_local std::string body;
+    body.clear();
+    putVarint(body, client_id);
+    putVarint(body, args.size());
+    for (const auto& arg : args) {
+        putVarint(body, arg.str.size());
+        body += arg.str;
+    }
+    appendRecord(body);
+}
+
+void captureDisconnect(uint64_t client_id) {
+    static thread_local std::string body;
+    body.clear();
+    putVarint(body, client_id);
+    putVarint(body, 0);
+    appendRecord(body);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "resp_parser.h"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+// Traffic capture for the replay tool. While a capture file is set, every
+// command a client sends is recorded with the time it arrived, and each
+// disconnect is noted. Event loop threads only append the encoded record to
+// an in-memory buffer; a background thread writes it to the file, so a slow
+// disk never stalls a loop. If the writer falls behind by more than
+// CAPTURE_BUFFER_MAX, records are dropped and counted instead.
+//
+// File format: the 8-byte magic "RSCAP01\n", then records of varints
+//   <microseconds since the previous record> <client id> <argc>
+// followed by argc (<length> <bytes>) arguments. argc 0 marks a disconnect.
+
+constexpr char CAPTURE_MAGIC[] = "RSCAP01\n";
+constexpr size_t CAPTURE_MAGIC_LEN = 8;
+
+// Unwritten capture bytes beyond which new records are dropped
+constexpr size_t CAPTURE_BUFFER_MAX = 64 * 1024 * 1024;
+
+// Set when a capture is running; checked before building any record
+extern std::atomic<bool> capture_enabled;
+
+// Directory captures are written to (startup only, before any capture)
+bool setCaptureDir(const std::string& dir, std::string& err);
+std::string captureDir();
+
+// Start capturing to a new file of that name in the capture directory,
+// ending any capture in progress; an existing file is never overwritten.
+// An empty name just stops. Returns once the stopped capture is fully
+// written. On failure returns false with err set.
+bool setCaptureFile(const std::string& name, std::string& err);
+
+// File name of the running capture, empty if none
+std::string captureFile();
+
+// Record a command / a disconnect (any event loop thread)
+void captureCommand(uint64_t client_id, const std::vector<RESPValue>& args);
+void captureDisconnect(uint64_t client_id);
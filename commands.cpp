@@ -1,10 +1,65 @@
 #include "commands.h"
+#include "config.h"
+#include "memory.h"
+#include "expire.h"
+#include "pubsub.h"
+#include "partition.h"
 #include <stdexcept>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <limits>
 
 // Global streams storage
-std::map<std::string, std::shared_ptr<Stream>> streams;
+Keyspace streams;
 
-RESPValue handleXADD(const std::vector<RESPValue>& args) {
+// Commands that modify data run one at a time under write_mutex, which also
+// makes each stream single-writer. Read-only stream commands skip it: they
+// hold keys_mutex only long enough to look the key up, then traverse the
+// stream lock-free while the writer keeps appending. The keyspace itself
+// (including incremental rehash steps) is only modified with both locks held.
+std::mutex write_mutex;
+static std::mutex keys_mutex;
+
+std::shared_ptr<Stream> lookupStream(const std::string& key) {
+    std::lock_guard<std::mutex> lock(keys_mutex);
+    return streams.findShared(key);
+}
+
+// Upper bound on XPCREATE partitions
+constexpr int MAX_PARTITIONS = 1024;
+
+// Slots migrated per background tick while no writes drive a resize
+constexpr size_t IDLE_REHASH_SLOTS = 4096;
+
+void rehashKeyspace() {
+    std::lock_guard<std::mutex> lock(keys_mutex);
+    streams.rehashStep(IDLE_REHASH_SLOTS);
+}
+
+// Entry-level commands that partitioned streams don't implement
+static RESPValue partitionedUnsupported(const char* command) {
+    return RESPValue(RESPType::Error, std::string("ERR ") + command + " is not supported on a partitioned stream");
+}
+
+// XRANGE bound: "-" / "+", "ms-seq", or a bare "ms" covering the whole millisecond
+static bool parseRangeBound(const std::string& str, bool is_end, StreamID& out) {
+    if (str == "-") {
+        out = StreamID();
+        return true;
+    }
+    if (str == "+") {
+        out = StreamID(UINT64_MAX, UINT64_MAX);
+        return true;
+    }
+    if (!StreamID::parse(str, out)) return false;
+    if (is_end && str.find('-') == std::string::npos) {
+        out.seq = UINT64_MAX;
+    }
+    return true;
+}
+
+RESPValue handleXADD(std::vector<RESPValue>& args) {
     if (args.size() < 4) {
         return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xadd' command");
     }
@@ -13,29 +68,178 @@ RESPValue handleXADD(const std::vector<RESPValue>& args) {
     std::string key = args[1].str;
     std::string id = args[2].str;
     
-    // Parse field-value pairs
-    std::map<std::string, std::string> fields;
+    // Parse field-value pairs, taking the values over from the arguments
+    FieldMap fields;
     for (size_t i = 3; i < args.size(); i += 2) {
         if (i + 1 >= args.size()) {
             return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xadd' command");
         }
-        fields[args[i].str] = args[i + 1].str;
+        fields[args[i].str] = FieldValue(std::move(args[i + 1].str));
     }
     
     // Get or create stream
-    if (streams.find(key) == streams.end()) {
-        streams[key] = std::make_shared<Stream>();
+    Stream* stream = streams.find(key);
+    if (!stream) {
+        std::lock_guard<std::mutex> lock(keys_mutex);
+        stream = streams.insert(key, std::make_shared<Stream>());
     }
     
     try {
-        std::string entry_id = streams[key]->addEntry(fields, id);
+        PartitionedStream* parts = stream->partitions();
+        std::string entry_id = parts ? parts->addEntry(std::move(fields), id)
+                                     : stream->addEntry(std::move(fields), id);
+        notifyStreamSubscribers(key);
         return RESPValue(RESPType::BulkString, entry_id);
     } catch (const std::exception& e) {
         return RESPValue(RESPType::Error, "ERR " + std::string(e.what()));
     }
 }
 
-RESPValue handlePING(const std::vector<RESPValue>& args) {
+RESPValue handleXPCREATE(std::vector<RESPValue>& args) {
+    // XPCREATE key partitions [HASH field]
+    if (args.size() != 3 && args.size() != 5) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xpcreate' command");
+    }
+
+    int count;
+    try {
+        count = std::stoi(args[2].str);
+    } catch (const std::exception& e) {
+        count = 0;
+    }
+    if (count < 1 || count > MAX_PARTITIONS) {
+        return RESPValue(RESPType::Error, "ERR partitions must be between 1 and " + std::to_string(MAX_PARTITIONS));
+    }
+
+    PartitionedStream::Policy policy = PartitionedStream::Policy::RoundRobin;
+    std::string field;
+    if (args.size() == 5) {
+        std::string option = args[3].str;
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (option != "HASH") {
+            return RESPValue(RESPType::Error, "ERR syntax error");
+        }
+        policy = PartitionedStream::Policy::Hash;
+        field = args[4].str;
+    }
+
+    const std::string& key = args[1].str;
+    if (streams.find(key)) {
+        return RESPValue(RESPType::Error, "ERR key already exists");
+    }
+
+    std::unique_ptr<PartitionedStream> parts(new PartitionedStream(count, policy, field));
+    std::lock_guard<std::mutex> lock(keys_mutex);
+    streams.insert(key, std::make_shared<Stream>(std::move(parts)));
+    return RESPValue(RESPType::SimpleString, "OK");
+}
+
+RESPValue handleXPADD(std::vector<RESPValue>& args) {
+    // XPADD key ID field value [field value ...]
+    if (args.size() < 5 || args.size() % 2 == 0) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xpadd' command");
+    }
+
+    FieldMap fields;
+    for (size_t i = 3; i < args.size(); i += 2) {
+        fields[args[i].str] = FieldValue(std::move(args[i + 1].str));
+    }
+
+    // Without the write lock this can't evict; the next locked write or
+    // background tick does
+    size_t limit = server_config.maxmemory.load();
+    if (limit > 0 && memoryUsed() > limit) {
+        return RESPValue(RESPType::Error, "OOM command not allowed when used memory > 'maxmemory'.");
+    }
+
+    const std::string& key = args[1].str;
+    std::shared_ptr<Stream> stream = lookupStream(key);
+    if (!stream || !stream->partitions()) {
+        return RESPValue(RESPType::Error, "ERR no such partitioned stream (create it with XPCREATE)");
+    }
+
+    try {
+        std::string entry_id = stream->partitions()->addEntry(std::move(fields), args[2].str);
+        notifyStreamSubscribers(key);
+        return RESPValue(RESPType::BulkString, entry_id);
+    } catch (const std::exception& e) {
+        return RESPValue(RESPType::Error, "ERR " + std::string(e.what()));
+    }
+}
+
+RESPValue handleXADDBATCH(std::vector<RESPValue>& args) {
+    // XADDBATCH key ID numfields field value [field value ...] [ID numfields ...]
+    if (args.size() < 6) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xaddbatch' command");
+    }
+
+    std::string key = args[1].str;
+
+    // Parse and validate every entry before touching the stream, so a bad
+    // entry rejects the whole batch instead of leaving half of it applied
+    std::vector<std::pair<std::string, FieldMap>> entries;
+    size_t i = 2;
+    while (i < args.size()) {
+        if (i + 1 >= args.size()) {
+            return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xaddbatch' command");
+        }
+
+        const std::string& id = args[i].str;
+        StreamID parsed;
+        if (id != "*" && (id.find('-') == std::string::npos || !StreamID::parse(id, parsed))) {
+            return RESPValue(RESPType::Error, "ERR Invalid ID format");
+        }
+
+        size_t num_fields;
+        try {
+            size_t used;
+            num_fields = std::stoul(args[i + 1].str, &used);
+            if (used != args[i + 1].str.size() || num_fields == 0) {
+                throw std::invalid_argument("numfields");
+            }
+        } catch (const std::exception& e) {
+            return RESPValue(RESPType::Error, "ERR numfields must be a positive integer");
+        }
+        if (num_fields > (args.size() - i - 2) / 2) {
+            return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xaddbatch' command");
+        }
+
+        FieldMap fields;
+        for (size_t f = 0; f < num_fields; ++f) {
+            fields[args[i + 2 + 2 * f].str] = FieldValue(std::move(args[i + 3 + 2 * f].str));
+        }
+        entries.emplace_back(id, std::move(fields));
+        i += 2 + 2 * num_fields;
+    }
+
+    // One key lookup for the whole batch
+    Stream* stream = streams.find(key);
+    if (!stream) {
+        std::lock_guard<std::mutex> lock(keys_mutex);
+        stream = streams.insert(key, std::make_shared<Stream>());
+    }
+
+    try {
+        std::vector<RESPValue> ids;
+        ids.reserve(entries.size());
+        if (PartitionedStream* parts = stream->partitions()) {
+            // Each entry may land in a different partition
+            for (auto& entry : entries) {
+                ids.push_back(RESPValue(RESPType::BulkString, parts->addEntry(std::move(entry.second), entry.first)));
+            }
+        } else {
+            for (auto& entry_id : stream->addEntries(std::move(entries))) {
+                ids.push_back(RESPValue(RESPType::BulkString, std::move(entry_id)));
+            }
+        }
+        notifyStreamSubscribers(key);
+        return RESPValue(std::move(ids));
+    } catch (const std::exception& e) {
+        return RESPValue(RESPType::Error, "ERR " + std::string(e.what()));
+    }
+}
+
+RESPValue handlePING(std::vector<RESPValue>& args) {
     if (args.size() == 1) {
         return RESPValue(RESPType::SimpleString, "PONG");
     } else if (args.size() == 2) {
@@ -45,7 +249,7 @@ RESPValue handlePING(const std::vector<RESPValue>& args) {
     }
 }
 
-RESPValue handleECHO(const std::vector<RESPValue>& args) {
+RESPValue handleECHO(std::vector<RESPValue>& args) {
     if (args.size() < 2) {
         return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'echo' command");
     }
@@ -60,7 +264,7 @@ RESPValue handleECHO(const std::vector<RESPValue>& args) {
     return RESPValue(RESPType::BulkString, message);
 }
 
-RESPValue handleXLEN(const std::vector<RESPValue>& args) {
+RESPValue handleXLEN(std::vector<RESPValue>& args) {
     if (args.size() != 2) {
         return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xlen' command");
     }
@@ -68,20 +272,21 @@ RESPValue handleXLEN(const std::vector<RESPValue>& args) {
     std::string key = args[1].str;
     
     // Check if stream exists
-    if (streams.find(key) == streams.end()) {
+    auto stream = lookupStream(key);
+    if (!stream) {
         return RESPValue(0); // Return 0 for non-existent streams
     }
     
-    size_t length = streams[key]->length();
+    size_t length = stream->partitions() ? stream->partitions()->length() : stream->length();
     return RESPValue(static_cast<int64_t>(length));
 }
 
-RESPValue handleQUIT(const std::vector<RESPValue>& args) {
+RESPValue handleQUIT(std::vector<RESPValue>& args) {
     (void)args; // Suppress unused parameter warning
     return RESPValue(RESPType::SimpleString, "OK");
 }
 
-RESPValue handleXREAD(const std::vector<RESPValue>& args) {
+RESPValue handleXREAD(std::vector<RESPValue>& args) {
     if (args.size() < 4) {
         return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xread' command");
     }
@@ -124,46 +329,41 @@ RESPValue handleXREAD(const std::vector<RESPValue>& args) {
         std::string key = keys[i];
         std::string id = ids[i];
         
-        if (streams.find(key) == streams.end()) {
+        auto stream = lookupStream(key);
+        if (!stream) {
             // Stream doesn't exist, skip it
             continue;
         }
         
-        // Get entries newer than the specified ID
-        std::vector<StreamEntry> new_entries;
-        const auto& stream = streams[key];
-        
-        // Directly iterate through entries to find newer ones
-        for (const auto& entry : stream->getEntries()) {
-            if (id == "0" || entry.id > id) {
-                new_entries.push_back(entry);
+        // Get entries newer than the specified ID. Each entry's cached
+        // encoding is referenced, not rebuilt, so fan-out to many readers
+        // costs no serialization work after the first.
+        std::vector<RESPValue> stream_data;
+        if (PartitionedStream* parts = stream->partitions()) {
+            StreamID after;
+            if (!StreamID::parse(id, after)) {
+                return RESPValue(RESPType::Error, "ERR Invalid stream ID specified as stream command argument");
+            }
+            StreamID start = id == "0" ? StreamID() : StreamID(after.ms, after.seq + 1);
+            for (auto& entry : parts->getRange(start, StreamID(UINT64_MAX, UINT64_MAX), -1)) {
+                stream_data.push_back(RESPValue(std::move(entry)));
             }
+        } else {
+            stream->forEachEntry([&](const StreamEntry& entry) {
+                if (id == "0" || entry.id > id) {
+                    stream_data.push_back(RESPValue(entry.encoded()));
+                }
+                return true;
+            });
         }
         
-        if (!new_entries.empty()) {
+        if (!stream_data.empty()) {
             // Create stream entry array: [key, [[id, [field, value, ...]], ...]]
-            std::vector<RESPValue> stream_data;
-            
-            for (const auto& entry : new_entries) {
-                std::vector<RESPValue> entry_data;
-                entry_data.push_back(RESPValue(RESPType::BulkString, entry.id));
-                
-                // Add field-value pairs
-                std::vector<RESPValue> fields;
-                for (const auto& field : entry.fields) {
-                    fields.push_back(RESPValue(RESPType::BulkString, field.first));
-                    fields.push_back(RESPValue(RESPType::BulkString, field.second));
-                }
-                entry_data.push_back(RESPValue(fields));
-                
-                stream_data.push_back(RESPValue(entry_data));
-            }
-            
             std::vector<RESPValue> stream_entry;
             stream_entry.push_back(RESPValue(RESPType::BulkString, key));
-            stream_entry.push_back(RESPValue(stream_data));
+            stream_entry.push_back(RESPValue(std::move(stream_data)));
             
-            response_array.push_back(RESPValue(stream_entry));
+            response_array.push_back(RESPValue(std::move(stream_entry)));
         }
     }
     
@@ -175,73 +375,97 @@ RESPValue handleXREAD(const std::vector<RESPValue>& args) {
     return RESPValue(response_array);
 }
 
-RESPValue handleXRANGE(const std::vector<RESPValue>& args) {
+// XRANGE key start end [COUNT count] / XREVRANGE key end start [COUNT count].
+// Returns false with the error in reply; otherwise stream is the key's
+// stream (null if missing) and walk covers the range.
+static bool parseRangeCommand(const std::vector<RESPValue>& args, bool reverse, std::shared_ptr<Stream>& stream,
+                              std::unique_ptr<RangeWalk>& walk, size_t& count, RESPValue& reply) {
+    const char* name = reverse ? "xrevrange" : "xrange";
     if (args.size() < 4) {
-        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xrange' command");
+        reply = RESPValue(RESPType::Error, std::string("ERR wrong number of arguments for '") + name + "' command");
+        return false;
     }
-    
-    // XRANGE key start end [COUNT count]
-    std::string key = args[1].str;
-    std::string start = args[2].str;
-    std::string end = args[3].str;
-    int count = -1; // Default: no limit
-    
-    // Parse COUNT if provided
+
+    count = std::numeric_limits<size_t>::max();  // Default (and COUNT 0): no limit
     if (args.size() >= 6 && args[4].str == "COUNT") {
         try {
-            count = std::stoi(args[5].str);
-            if (count < 0) {
-                return RESPValue(RESPType::Error, "ERR COUNT must be positive");
+            int n = std::stoi(args[5].str);
+            if (n < 0) {
+                reply = RESPValue(RESPType::Error, "ERR COUNT must be positive");
+                return false;
+            }
+            if (n > 0) {
+                count = static_cast<size_t>(n);
             }
         } catch (const std::exception& e) {
-            return RESPValue(RESPType::Error, "ERR COUNT must be an integer");
+            reply = RESPValue(RESPType::Error, "ERR COUNT must be an integer");
+            return false;
         }
     }
-    
-    // Check if stream exists
-    if (streams.find(key) == streams.end()) {
-        return RESPValue(std::vector<RESPValue>()); // Empty array
+
+    // XREVRANGE takes the bounds highest first
+    StreamID range_start, range_end;
+    const std::string& start = args[reverse ? 3 : 2].str;
+    const std::string& end = args[reverse ? 2 : 3].str;
+    if (!parseRangeBound(start, false, range_start) || !parseRangeBound(end, true, range_end)) {
+        reply = RESPValue(RESPType::Error, "ERR Invalid stream ID specified as stream command argument");
+        return false;
     }
-    
-    const auto& stream = streams[key];
-    std::vector<StreamEntry> range_entries;
-    
-    // Handle special start/end IDs
-    std::string actual_start = (start == "-") ? "0" : start;
-    std::string actual_end = (end == "+") ? "9999999999999-999999999" : end;
-    
-    // Get entries in range
-    for (const auto& entry : stream->getEntries()) {
-        if (entry.id >= actual_start && entry.id <= actual_end) {
-            range_entries.push_back(entry);
-            if (count > 0 && range_entries.size() >= static_cast<size_t>(count)) {
-                break;
-            }
-        }
+
+    stream = lookupStream(args[1].str);
+    if (!stream) return true;
+
+    // Partitioned streams: k-way merge of the partitions by ID
+    if (PartitionedStream* parts = stream->partitions()) {
+        walk.reset(new RangeWalk(parts->walk(range_start, range_end, reverse)));
+    } else {
+        walk.reset(new RangeWalk({stream.get()}, range_start, range_end, reverse));
     }
-    
-    // Build response array
-    std::vector<RESPValue> response_array;
-    
-    for (const auto& entry : range_entries) {
-        std::vector<RESPValue> entry_data;
-        entry_data.push_back(RESPValue(RESPType::BulkString, entry.id));
-        
-        // Add field-value pairs
-        std::vector<RESPValue> fields;
-        for (const auto& field : entry.fields) {
-            fields.push_back(RESPValue(RESPType::BulkString, field.first));
-            fields.push_back(RESPValue(RESPType::BulkString, field.second));
-        }
-        entry_data.push_back(RESPValue(fields));
-        
-        response_array.push_back(RESPValue(entry_data));
+    return true;
+}
+
+// Build the whole reply at once (inside MULTI, where it is part of EXEC's)
+static RESPValue rangeCommand(std::vector<RESPValue>& args, bool reverse) {
+    std::shared_ptr<Stream> stream;
+    std::unique_ptr<RangeWalk> walk;
+    size_t count;
+    RESPValue error;
+    if (!parseRangeCommand(args, reverse, stream, walk, count, error)) {
+        return error;
     }
-    
-    return RESPValue(response_array);
+
+    std::vector<RESPValue> entries;
+    if (walk) {
+        walk->next(count, [&](const StreamEntry& entry) {
+            entries.push_back(RESPValue(entry.encoded()));
+            return true;
+        });
+    }
+    return RESPValue(std::move(entries));
+}
+
+RESPValue handleXRANGE(std::vector<RESPValue>& args) {
+    return rangeCommand(args, false);
+}
+
+RESPValue handleXREVRANGE(std::vector<RESPValue>& args) {
+    return rangeCommand(args, true);
+}
+
+std::unique_ptr<RangeReply> openRangeReply(const std::vector<RESPValue>& args, bool reverse, RESPValue& error) {
+    std::shared_ptr<Stream> stream;
+    std::unique_ptr<RangeWalk> walk;
+    size_t count;
+    if (!parseRangeCommand(args, reverse, stream, walk, count, error)) {
+        return nullptr;
+    }
+    if (!walk) {
+        return std::unique_ptr<RangeReply>(new RangeReply(nullptr, RangeWalk({}, StreamID(), StreamID(), reverse), 0));
+    }
+    return std::unique_ptr<RangeReply>(new RangeReply(std::move(stream), *walk, count));
 }
 
-RESPValue handleXDEL(const std::vector<RESPValue>& args) {
+RESPValue handleXDEL(std::vector<RESPValue>& args) {
     if (args.size() < 3) {
         return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xdel' command");
     }
@@ -256,17 +480,22 @@ RESPValue handleXDEL(const std::vector<RESPValue>& args) {
     }
     
     // Check if stream exists
-    if (streams.find(key) == streams.end()) {
+    Stream* stream = streams.find(key);
+    if (!stream) {
         return RESPValue(0); // Return 0 for non-existent streams
     }
     
+    if (stream->partitions()) {
+        return partitionedUnsupported("XDEL");
+    }
+
     // Delete the entries
-    int deleted_count = streams[key]->deleteEntries(ids_to_delete);
+    int deleted_count = stream->deleteEntries(ids_to_delete);
     
     return RESPValue(static_cast<int64_t>(deleted_count));
 }
 
-RESPValue handleXTRIM(const std::vector<RESPValue>& args) {
+RESPValue handleXTRIM(std::vector<RESPValue>& args) {
     if (args.size() < 4) {
         return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xtrim' command");
     }
@@ -289,43 +518,506 @@ RESPValue handleXTRIM(const std::vector<RESPValue>& args) {
     }
     
     // Check if stream exists
-    if (streams.find(key) == streams.end()) {
+    Stream* stream = streams.find(key);
+    if (!stream) {
         return RESPValue(0); // Return 0 for non-existent streams
     }
     
+    if (stream->partitions()) {
+        return partitionedUnsupported("XTRIM");
+    }
+
     // Trim the stream
-    int removed_count = streams[key]->trimToLength(max_length);
+    int removed_count = stream->trimToLength(max_length);
     
     return RESPValue(static_cast<int64_t>(removed_count));
 }
 
-RESPValue handleCommand(const RESPValue& command) {
-    if (command.type != RESPType::Array || command.array.empty()) {
-        return RESPValue(RESPType::Error, "ERR invalid command");
+RESPValue handleXRETENTION(std::vector<RESPValue>& args) {
+    // XRETENTION key [milliseconds] - get, or set (0 disables) the max entry age
+    if (args.size() != 2 && args.size() != 3) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xretention' command");
     }
-    
+
+    Stream* stream = streams.find(args[1].str);
+    if (!stream) {
+        return RESPValue(RESPType::Error, "ERR no such key");
+    }
+
+    if (args.size() == 2) {
+        return RESPValue(static_cast<int64_t>(stream->retention()));
+    }
+
+    uint64_t retention_ms;
+    try {
+        size_t used;
+        retention_ms = std::stoull(args[2].str, &used);
+        if (used != args[2].str.size() || args[2].str[0] == '-') {
+            throw std::invalid_argument("retention");
+        }
+    } catch (const std::exception& e) {
+        return RESPValue(RESPType::Error, "ERR retention must be a non-negative integer");
+    }
+
+    // Expired entries go on the next active expiry ticks, not here
+    stream->setRetention(retention_ms);
+    return RESPValue(RESPType::SimpleString, "OK");
+}
+
+RESPValue handleXINDEX(std::vector<RESPValue>& args) {
+    // XINDEX CREATE|DROP key field
+    if (args.size() != 4) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xindex' command");
+    }
+
+    std::string subcommand = args[1].str;
+    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+    if (subcommand != "CREATE" && subcommand != "DROP") {
+        return RESPValue(RESPType::Error, "ERR unknown subcommand '" + args[1].str + "' for 'xindex' command");
+    }
+
+    Stream* stream = streams.find(args[2].str);
+    if (!stream) {
+        return RESPValue(RESPType::Error, "ERR no such key");
+    }
+
+    if (stream->partitions()) {
+        return partitionedUnsupported("XINDEX");
+    }
+
+    // 1 if the index was created (or dropped), 0 if it already was (or wasn't)
+    const std::string& field = args[3].str;
+    bool changed = subcommand == "CREATE" ? stream->createIndex(field) : stream->dropIndex(field);
+    return RESPValue(static_cast<int64_t>(changed ? 1 : 0));
+}
+
+RESPValue handleXQUERY(std::vector<RESPValue>& args) {
+    // XQUERY key field value [AFTER id] [COUNT count]
+    if (args.size() < 4 || args.size() % 2 != 0) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xquery' command");
+    }
+
+    bool has_after = false;
+    StreamID after;
+    int count = -1;
+    for (size_t i = 4; i < args.size(); i += 2) {
+        std::string option = args[i].str;
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+
+        if (option == "AFTER") {
+            if (!StreamID::parse(args[i + 1].str, after)) {
+                return RESPValue(RESPType::Error, "ERR Invalid stream ID specified as stream command argument");
+            }
+            has_after = true;
+        } else if (option == "COUNT") {
+            try {
+                count = std::stoi(args[i + 1].str);
+            } catch (const std::exception& e) {
+                return RESPValue(RESPType::Error, "ERR value is not an integer or out of range");
+            }
+        } else {
+            return RESPValue(RESPType::Error, "ERR syntax error");
+        }
+    }
+
+    Stream* stream = streams.find(args[1].str);
+    if (!stream) {
+        return RESPValue(std::vector<RESPValue>());
+    }
+
+    if (stream->partitions()) {
+        return partitionedUnsupported("XQUERY");
+    }
+
+    const std::string& field = args[2].str;
+    if (!stream->hasIndex(field)) {
+        return RESPValue(RESPType::Error, "ERR no index on field '" + field + "'");
+    }
+
+    std::vector<RESPValue> response_array;
+    for (auto& entry : stream->queryIndex(field, args[3].str, has_after ? &after : nullptr, count)) {
+        response_array.push_back(RESPValue(std::move(entry)));
+    }
+    return RESPValue(std::move(response_array));
+}
+
+RESPValue handleXINFO(std::vector<RESPValue>& args) {
+    if (args.size() < 2) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xinfo' command");
+    }
+
+    std::string subcommand = args[1].str;
+    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+
+    if (subcommand != "STREAM") {
+        return RESPValue(RESPType::Error, "ERR unknown subcommand '" + args[1].str + "' for 'xinfo' command");
+    }
+    if (args.size() != 3) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xinfo|stream' command");
+    }
+
+    const Stream* found = streams.find(args[2].str);
+    if (!found) {
+        return RESPValue(RESPType::Error, "ERR no such key");
+    }
+    const Stream& stream = *found;
+
+    if (PartitionedStream* parts = stream.partitions()) {
+        // Totals over the partitions: O(partitions)
+        std::vector<RESPValue> info;
+        info.push_back(RESPValue(RESPType::BulkString, "length"));
+        info.push_back(RESPValue(static_cast<int64_t>(parts->length())));
+        info.push_back(RESPValue(RESPType::BulkString, "memory-usage"));
+        info.push_back(RESPValue(static_cast<int64_t>(stream.memoryUsage() + parts->memoryUsage())));
+        info.push_back(RESPValue(RESPType::BulkString, "last-generated-id"));
+        info.push_back(RESPValue(RESPType::BulkString, parts->lastGeneratedId()));
+        info.push_back(RESPValue(RESPType::BulkString, "entries-added"));
+        info.push_back(RESPValue(static_cast<int64_t>(parts->entriesAdded())));
+        info.push_back(RESPValue(RESPType::BulkString, "retention-ms"));
+        info.push_back(RESPValue(static_cast<int64_t>(stream.retention())));
+        info.push_back(RESPValue(RESPType::BulkString, "partitions"));
+        info.push_back(RESPValue(static_cast<int64_t>(parts->partitionCount())));
+        info.push_back(RESPValue(RESPType::BulkString, "partition-by"));
+        info.push_back(RESPValue(RESPType::BulkString, parts->policy() == PartitionedStream::Policy::Hash
+                                                           ? parts->hashField() : "round-robin"));
+        return RESPValue(info);
+    }
+
+    // Every field below is cached on the stream, so this is O(1)
+    std::vector<RESPValue> info;
+    info.push_back(RESPValue(RESPType::BulkString, "length"));
+    info.push_back(RESPValue(static_cast<int64_t>(stream.length())));
+    info.push_back(RESPValue(RESPType::BulkString, "memory-usage"));
+    info.push_back(RESPValue(static_cast<int64_t>(stream.memoryUsage())));
+    info.push_back(RESPValue(RESPType::BulkString, "last-generated-id"));
+    info.push_back(RESPValue(RESPType::BulkString, stream.lastGeneratedId()));
+    info.push_back(RESPValue(RESPType::BulkString, "entries-added"));
+    info.push_back(RESPValue(static_cast<int64_t>(stream.entriesAdded())));
+    info.push_back(RESPValue(RESPType::BulkString, "retention-ms"));
+    info.push_back(RESPValue(static_cast<int64_t>(stream.retention())));
+    info.push_back(RESPValue(RESPType::BulkString, "indexes"));
+    std::vector<RESPValue> indexed;
+    for (const auto& field : stream.indexedFields()) {
+        indexed.push_back(RESPValue(RESPType::BulkString, field));
+    }
+    info.push_back(RESPValue(std::move(indexed)));
+    info.push_back(RESPValue(RESPType::BulkString, "first-entry"));
+    info.push_back(stream.length() > 0 ? RESPValue(stream.firstEntry().encoded()) : RESPValue());
+    info.push_back(RESPValue(RESPType::BulkString, "last-entry"));
+    info.push_back(stream.length() > 0 ? RESPValue(stream.lastEntry().encoded()) : RESPValue());
+
+    return RESPValue(info);
+}
+
+RESPValue handleDEL(std::vector<RESPValue>& args) {
+    if (args.size() < 2) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'del' command");
+    }
+
+    // DEL key [key ...]
+    int64_t deleted = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+        // Hold a reference so a large stream is freed after keys_mutex is
+        // released rather than while lock-free readers wait on it
+        std::shared_ptr<Stream> doomed = streams.findShared(args[i].str);
+        if (!doomed) continue;
+
+        std::lock_guard<std::mutex> lock(keys_mutex);
+        streams.erase(args[i].str);
+        ++deleted;
+    }
+    return RESPValue(deleted);
+}
+
+RESPValue handleEXISTS(std::vector<RESPValue>& args) {
+    if (args.size() < 2) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'exists' command");
+    }
+
+    // EXISTS key [key ...] - a key named twice counts twice
+    int64_t count = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (lookupStream(args[i].str)) {
+            ++count;
+        }
+    }
+    return RESPValue(count);
+}
+
+RESPValue handleTYPE(std::vector<RESPValue>& args) {
+    if (args.size() != 2) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'type' command");
+    }
+
+    // Streams are the only value type
+    return RESPValue(RESPType::SimpleString, lookupStream(args[1].str) ? "stream" : "none");
+}
+
+RESPValue handleKEYS(std::vector<RESPValue>& args) {
+    if (args.size() != 2) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'keys' command");
+    }
+
+    // KEYS pattern - walks the whole keyspace; SCAN is the incremental form
+    std::vector<RESPValue> keys;
+    streams.forEach([&](const std::string& key, Stream&) {
+        if (globMatch(args[1].str, key)) {
+            keys.push_back(RESPValue(RESPType::BulkString, key));
+        }
+    });
+    return RESPValue(std::move(keys));
+}
+
+RESPValue handleSCAN(std::vector<RESPValue>& args) {
+    // SCAN cursor [MATCH pattern] [COUNT count] [TYPE type]
+    if (args.size() < 2 || args.size() % 2 != 0) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'scan' command");
+    }
+
+    uint64_t cursor;
+    try {
+        size_t used;
+        cursor = std::stoull(args[1].str, &used);
+        if (used != args[1].str.size() || args[1].str[0] == '-') {
+            throw std::invalid_argument("cursor");
+        }
+    } catch (const std::exception& e) {
+        return RESPValue(RESPType::Error, "ERR invalid cursor");
+    }
+
+    const std::string* pattern = nullptr;
+    size_t count = 10;
+    bool type_matches = true;
+    for (size_t i = 2; i < args.size(); i += 2) {
+        std::string option = args[i].str;
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+
+        if (option == "MATCH") {
+            pattern = &args[i + 1].str;
+        } else if (option == "COUNT") {
+            int n;
+            try {
+                n = std::stoi(args[i + 1].str);
+            } catch (const std::exception& e) {
+                return RESPValue(RESPType::Error, "ERR value is not an integer or out of range");
+            }
+            if (n < 1) {
+                return RESPValue(RESPType::Error, "ERR syntax error");
+            }
+            count = static_cast<size_t>(n);
+        } else if (option == "TYPE") {
+            std::string type = args[i + 1].str;
+            std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+            type_matches = type == "stream";
+        } else {
+            return RESPValue(RESPType::Error, "ERR syntax error");
+        }
+    }
+
+    // COUNT bounds the keys examined, not the keys returned; give up on a
+    // sparse stretch of table after ten times as many buckets
+    std::vector<RESPValue> keys;
+    size_t examined = 0;
+    size_t buckets = 0;
+    do {
+        cursor = streams.scan(cursor, [&](const std::string& key, Stream&) {
+            ++examined;
+            if (type_matches && (!pattern || globMatch(*pattern, key))) {
+                keys.push_back(RESPValue(RESPType::BulkString, key));
+            }
+        });
+    } while (cursor != 0 && examined < count && ++buckets < count * 10);
+
+    std::vector<RESPValue> reply;
+    reply.push_back(RESPValue(RESPType::BulkString, std::to_string(cursor)));
+    reply.push_back(RESPValue(std::move(keys)));
+    return RESPValue(std::move(reply));
+}
+
+RESPValue handleMEMORY(std::vector<RESPValue>& args) {
+    if (args.size() < 2) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'memory' command");
+    }
+
+    std::string subcommand = args[1].str;
+    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+
+    if (subcommand == "USAGE") {
+        // MEMORY USAGE key [SAMPLES count] - accounting is exact, SAMPLES is ignored
+        if (args.size() != 3 && args.size() != 5) {
+            return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'memory|usage' command");
+        }
+
+        Stream* stream = streams.find(args[2].str);
+        if (!stream) {
+            return RESPValue();
+        }
+
+        // Stream data plus its keyspace slot
+        size_t bytes = stream->memoryUsage() + Keyspace::keyOverhead(args[2].str);
+        if (stream->partitions()) {
+            bytes += stream->partitions()->memoryUsage();
+        }
+        return RESPValue(static_cast<int64_t>(bytes));
+    }
+
+    if (subcommand == "STATS") {
+        std::string policy;
+        getConfig("maxmemory-policy", policy);
+
+        std::vector<RESPValue> stats;
+        stats.push_back(RESPValue(RESPType::BulkString, "used-memory"));
+        stats.push_back(RESPValue(static_cast<int64_t>(memoryUsed())));
+        stats.push_back(RESPValue(RESPType::BulkString, "maxmemory"));
+        stats.push_back(RESPValue(static_cast<int64_t>(server_config.maxmemory.load())));
+        stats.push_back(RESPValue(RESPType::BulkString, "maxmemory-policy"));
+        stats.push_back(RESPValue(RESPType::BulkString, policy));
+        stats.push_back(RESPValue(RESPType::BulkString, "keys"));
+        stats.push_back(RESPValue(static_cast<int64_t>(streams.size())));
+        stats.push_back(RESPValue(RESPType::BulkString, "expired-entries"));
+        stats.push_back(RESPValue(static_cast<int64_t>(expiredEntriesTotal())));
+        return RESPValue(stats);
+    }
+
+    return RESPValue(RESPType::Error, "ERR unknown subcommand '" + args[1].str + "' for 'memory' command");
+}
+
+RESPValue handleCONFIG(std::vector<RESPValue>& args) {
+    if (args.size() < 3) {
+        return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'config' command");
+    }
+
+    std::string subcommand = args[1].str;
+    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+
+    if (subcommand == "GET") {
+        // CONFIG GET parameter (or * for all)
+        std::vector<std::string> names;
+        if (args[2].str == "*") {
+            names = configNames();
+        } else {
+            names.push_back(args[2].str);
+        }
+
+        std::vector<RESPValue> result;
+        for (const auto& name : names) {
+            std::string value;
+            if (getConfig(name, value)) {
+                result.push_back(RESPValue(RESPType::BulkString, name));
+                result.push_back(RESPValue(RESPType::BulkString, value));
+            }
+        }
+        return RESPValue(result);
+    }
+
+    if (subcommand == "SET") {
+        if (args.size() != 4) {
+            return RESPValue(RESPType::Error, "ERR wrong number of arguments for 'config|set' command");
+        }
+
+        std::string err;
+        if (!setConfig(args[2].str, args[3].str, err)) {
+            return RESPValue(RESPType::Error, err);
+        }
+        return RESPValue(RESPType::SimpleString, "OK");
+    }
+
+    return RESPValue(RESPType::Error, "ERR unknown subcommand '" + args[1].str + "' for 'config' command");
+}
+
+// Dispatch table entry
+struct CommandSpec {
+    RESPValue (*handler)(std::vector<RESPValue>&);
+    bool lock_free;  // Skips write_mutex: read-only, or locks what it writes itself (XPADD)
+    bool deny_oom;  // Grows memory: refused once eviction can't help
+    bool write;  // Changes data: refused while an event loop sheds load
+};
+
+static const std::unordered_map<std::string, CommandSpec> command_table = {
+    {"XADD", {handleXADD, false, true, true}},
+    {"XADDBATCH", {handleXADDBATCH, false, true, true}},
+    {"XPCREATE", {handleXPCREATE, false, false, true}},
+    {"XPADD", {handleXPADD, true, false, true}},  // Locks only the target partition
+    {"XLEN", {handleXLEN, true, false, false}},
+    {"XREAD", {handleXREAD, true, false, false}},
+    {"XRANGE", {handleXRANGE, true, false, false}},
+    {"XREVRANGE", {handleXREVRANGE, true, false, false}},
+    {"XDEL", {handleXDEL, false, false, true}},
+    {"XTRIM", {handleXTRIM, false, false, true}},
+    {"XRETENTION", {handleXRETENTION, false, false, true}},
+    {"XINDEX", {handleXINDEX, false, true, true}},
+    {"XQUERY", {handleXQUERY, false, false, false}},
+    {"XINFO", {handleXINFO, false, false, false}},
+    {"DEL", {handleDEL, false, false, true}},
+    {"EXISTS", {handleEXISTS, true, false, false}},
+    {"TYPE", {handleTYPE, true, false, false}},
+    {"KEYS", {handleKEYS, false, false, false}},
+    {"SCAN", {handleSCAN, false, false, false}},
+    {"MEMORY", {handleMEMORY, false, false, false}},
+    {"CONFIG", {handleCONFIG, true, false, false}},  // Settings are atomics; capture locks its own state
+    {"PING", {handlePING, true, false, false}},
+    {"ECHO", {handleECHO, true, false, false}},
+    {"QUIT", {handleQUIT, true, false, false}},
+};
+
+static std::string commandName(const RESPValue& command) {
     std::string cmd = command.array[0].str;
     std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    return cmd;
+}
+
+// Run a command once the caller holds whatever lock it needs
+static RESPValue callCommand(const CommandSpec& spec, std::vector<RESPValue>& args) {
+    if (spec.deny_oom && !freeMemoryIfNeeded()) {
+        return RESPValue(RESPType::Error, "OOM command not allowed when used memory > 'maxmemory'.");
+    }
+    return spec.handler(args);
+}
+
+bool commandExists(const std::string& name) {
+    std::string cmd = name;
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    return command_table.count(cmd) > 0;
+}
+
+bool commandIsWrite(const std::string& name) {
+    std::string cmd = name;
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+    auto it = command_table.find(cmd);
+    return it != command_table.end() && it->second.write;
+}
+
+RESPValue handleCommand(RESPValue& command) {
+    if (command.type != RESPType::Array || command.array.empty()) {
+        return RESPValue(RESPType::Error, "ERR invalid command");
+    }
     
-    if (cmd == "XADD") {
-        return handleXADD(command.array);
-    } else if (cmd == "XLEN") {
-        return handleXLEN(command.array);
-    } else if (cmd == "XREAD") {
-        return handleXREAD(command.array);
-    } else if (cmd == "XRANGE") {
-        return handleXRANGE(command.array);
-    } else if (cmd == "XDEL") {
-        return handleXDEL(command.array);
-    } else if (cmd == "XTRIM") {
-        return handleXTRIM(command.array);
-    } else if (cmd == "PING") {
-        return handlePING(command.array);
-    } else if (cmd == "ECHO") {
-        return handleECHO(command.array);
-    } else if (cmd == "QUIT") {
-        return handleQUIT(command.array);
-    } else {
+    auto it = command_table.find(commandName(command));
+    if (it == command_table.end()) {
         return RESPValue(RESPType::Error, "ERR unknown command '" + command.array[0].str + "'");
     }
-} 
\ No newline at end of file
+
+    std::unique_lock<std::mutex> lock(write_mutex, std::defer_lock);
+    if (!it->second.lock_free) {
+        lock.lock();
+    }
+    return callCommand(it->second, command.array);
+}
+
+RESPValue execTransaction(std::vector<RESPValue>& commands) {
+    // One lock acquisition for the whole transaction; no other client's
+    // write can interleave with it
+    std::lock_guard<std::mutex> lock(write_mutex);
+
+    std::vector<RESPValue> replies;
+    replies.reserve(commands.size());
+    for (auto& command : commands) {
+        auto it = command_table.find(commandName(command));
+        if (it == command_table.end()) {
+            replies.push_back(RESPValue(RESPType::Error, "ERR unknown command '" + command.array[0].str + "'"));
+            continue;
+        }
+        replies.push_back(callCommand(it->second, command.array));
+    }
+    return RESPValue(std::move(replies));
+}
@@ -1,22 +1,65 @@
 #pragma once
 #include "resp_parser.h"
 #include "stream.h"
-#include <map>
+#include "keyspace.h"
+#include "range.h"
 #include <memory>
+#include <mutex>
 
 // Global streams storage
-extern std::map<std::string, std::shared_ptr<Stream>> streams;
-
-// Command handlers
-RESPValue handleXADD(const std::vector<RESPValue>& args);
-RESPValue handleXLEN(const std::vector<RESPValue>& args);
-RESPValue handleXREAD(const std::vector<RESPValue>& args);
-RESPValue handleXRANGE(const std::vector<RESPValue>& args);
-RESPValue handleXDEL(const std::vector<RESPValue>& args);
-RESPValue handleXTRIM(const std::vector<RESPValue>& args);
-RESPValue handlePING(const std::vector<RESPValue>& args);
-RESPValue handleECHO(const std::vector<RESPValue>& args);
-RESPValue handleQUIT(const std::vector<RESPValue>& args);
+extern Keyspace streams;
+
+// Serializes everything that modifies streams or the keyspace, including
+// background tasks such as active expiry
+extern std::mutex write_mutex;
+
+// Look a stream up without write_mutex (read-only commands, push delivery)
+std::shared_ptr<Stream> lookupStream(const std::string& key);
+
+// Advance an in-progress keyspace resize from the background tick, so it
+// completes even when no writes arrive (caller holds write_mutex)
+void rehashKeyspace();
+
+// Command handlers. Handlers may consume their arguments: the XADD family
+// moves field values into the stream instead of copying them.
+RESPValue handleXADD(std::vector<RESPValue>& args);
+RESPValue handleXADDBATCH(std::vector<RESPValue>& args);
+RESPValue handleXPCREATE(std::vector<RESPValue>& args);
+RESPValue handleXPADD(std::vector<RESPValue>& args);
+RESPValue handleXLEN(std::vector<RESPValue>& args);
+RESPValue handleXREAD(std::vector<RESPValue>& args);
+RESPValue handleXRANGE(std::vector<RESPValue>& args);
+RESPValue handleXREVRANGE(std::vector<RESPValue>& args);
+RESPValue handleXDEL(std::vector<RESPValue>& args);
+RESPValue handleXTRIM(std::vector<RESPValue>& args);
+RESPValue handleXRETENTION(std::vector<RESPValue>& args);
+RESPValue handleXINDEX(std::vector<RESPValue>& args);
+RESPValue handleXQUERY(std::vector<RESPValue>& args);
+RESPValue handleXINFO(std::vector<RESPValue>& args);
+RESPValue handleDEL(std::vector<RESPValue>& args);
+RESPValue handleEXISTS(std::vector<RESPValue>& args);
+RESPValue handleTYPE(std::vector<RESPValue>& args);
+RESPValue handleKEYS(std::vector<RESPValue>& args);
+RESPValue handleSCAN(std::vector<RESPValue>& args);
+RESPValue handleMEMORY(std::vector<RESPValue>& args);
+RESPValue handleCONFIG(std::vector<RESPValue>& args);
+RESPValue handlePING(std::vector<RESPValue>& args);
+RESPValue handleECHO(std::vector<RESPValue>& args);
+RESPValue handleQUIT(std::vector<RESPValue>& args);
+
+// XRANGE / XREVRANGE as a reply the caller writes out incrementally.
+// Returns nullptr with the error reply set if the arguments are invalid.
+std::unique_ptr<RangeReply> openRangeReply(const std::vector<RESPValue>& args, bool reverse, RESPValue& error);
 
 // Main command dispatcher
-RESPValue handleCommand(const RESPValue& command); 
\ No newline at end of file
+RESPValue handleCommand(RESPValue& command);
+
+// Whether name (any case) is a command the dispatcher knows
+bool commandExists(const std::string& name);
+
+// Whether name (any case) is a command that changes data
+bool commandIsWrite(const std::string& name);
+
+// Run queued MULTI commands back to back under a single write lock
+// acquisition. Returns the array of their replies.
+RESPValue execTransaction(std::vector<RESPValue>& commands); 
\ No newline at end of file
@@ -0,0 +1,314 @@
+#include "config.h"
+#include "capture.h"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <limits>
+
+ServerConfig server_config;
+
+static std::string toLower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+bool parseMemorySize(const std::string& str, size_t& bytes) {
+    std::string s = toLower(str);
+    size_t digits = 0;
+    while (digits < s.size() && std::isdigit(static_cast<unsigned char>(s[digits]))) {
+        ++digits;
+    }
+    if (digits == 0) return false;
+
+    unsigned long long value;
+    try {
+        value = std::stoull(s.substr(0, digits));
+    } catch (const std::exception& e) {
+        return false;
+    }
+
+    std::string unit = s.substr(digits);
+    size_t multiplier;
+    if (unit.empty() || unit == "b") {
+        multiplier = 1;
+    } else if (unit == "k" || unit == "kb") {
+        multiplier = 1024;
+    } else if (unit == "m" || unit == "mb") {
+        multiplier = 1024 * 1024;
+    } else if (unit == "g" || unit == "gb") {
+        multiplier = 1024 * 1024 * 1024;
+    } else {
+        return false;
+    }
+
+    // A size that doesn't fit would wrap to a small limit
+    if (value > std::numeric_limits<size_t>::max() / multiplier) {
+        return false;
+    }
+    bytes = static_cast<size_t>(value) * multiplier;
+    return true;
+}
+
+static bool parseInt(const std::string& str, int min, int max, int& out) {
+    try {
+        size_t used;
+        int n = std::stoi(str, &used);
+        if (used != str.size() || n < min || n > max) return false;
+        out = n;
+        return true;
+    } catch (const std::exception& e) {
+        return false;
+    }
+}
+
+bool setConfig(const std::string& name, const std::string& value, std::string& err,
+               bool at_startup) {
+    std::string param = toLower(name);
+
+    if (param == "maxmemory") {
+        size_t bytes;
+        if (!parseMemorySize(value, bytes)) {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'maxmemory'";
+            return false;
+        }
+        server_config.maxmemory = bytes;
+        return true;
+    }
+
+    if (param == "maxmemory-policy") {
+        std::string policy = toLower(value);
+        if (policy == "noeviction") {
+            server_config.maxmemory_policy = MaxMemoryPolicy::NoEviction;
+        } else if (policy == "trim-oldest") {
+            server_config.maxmemory_policy = MaxMemoryPolicy::TrimOldest;
+        } else {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'maxmemory-policy'";
+            return false;
+        }
+        return true;
+    }
+
+    if (param == "io-threads") {
+        int threads;
+        if (!at_startup) {
+            err = "ERR CONFIG SET failed (possibly related to argument 'io-threads') - can't set immutable config";
+            return false;
+        }
+        if (!parseInt(value, 1, 128, threads)) {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'io-threads'";
+            return false;
+        }
+        server_config.io_threads = threads;
+        return true;
+    }
+
+    if (param == "io-backend") {
+        std::string backend = toLower(value);
+        if (!at_startup) {
+            err = "ERR CONFIG SET failed (possibly related to argument 'io-backend') - can't set immutable config";
+            return false;
+        }
+        if (backend == "epoll") {
+            server_config.io_backend = IOBackend::Epoll;
+        } else if (backend == "io_uring") {
+            server_config.io_backend = IOBackend::IoUring;
+        } else {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'io-backend'";
+            return false;
+        }
+        return true;
+    }
+
+    if (param == "client-output-buffer-limit") {
+        // "<hard> <soft> <soft-seconds>", e.g. "256mb 64mb 60"
+        std::istringstream iss(value);
+        std::string hard_str, soft_str, seconds_str, extra;
+        size_t hard, soft;
+        int seconds;
+        if (!(iss >> hard_str >> soft_str >> seconds_str) || (iss >> extra) ||
+            !parseMemorySize(hard_str, hard) || !parseMemorySize(soft_str, soft) ||
+            !parseInt(seconds_str, 0, 1000000, seconds)) {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'client-output-buffer-limit'";
+            return false;
+        }
+        server_config.client_obuf_hard = hard;
+        server_config.client_obuf_soft = soft;
+        server_config.client_obuf_soft_seconds = seconds;
+        return true;
+    }
+
+    if (param == "hz") {
+        int hz;
+        if (!parseInt(value, 1, 500, hz)) {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'hz'";
+            return false;
+        }
+        server_config.hz = hz;
+        return true;
+    }
+
+    if (param == "active-expire-budget-us") {
+        int budget;
+        if (!parseInt(value, 1, 1000000, budget)) {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'active-expire-budget-us'";
+            return false;
+        }
+        server_config.active_expire_budget_us = budget;
+        return true;
+    }
+
+    if (param == "maxclients") {
+        int clients;
+        if (!parseInt(value, 1, 1000000, clients)) {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'maxclients'";
+            return false;
+        }
+        server_config.maxclients = clients;
+        return true;
+    }
+
+    if (param == "tcp-backlog") {
+        int backlog;
+        if (!at_startup) {
+            err = "ERR CONFIG SET failed (possibly related to argument 'tcp-backlog') - can't set immutable config";
+            return false;
+        }
+        if (!parseInt(value, 1, 65535, backlog)) {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'tcp-backlog'";
+            return false;
+        }
+        server_config.tcp_backlog = backlog;
+        return true;
+    }
+
+    if (param == "client-command-rate") {
+        int rate;
+        if (!parseInt(value, 0, 100000000, rate)) {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'client-command-rate'";
+            return false;
+        }
+        server_config.client_command_rate = rate;
+        return true;
+    }
+
+    if (param == "client-max-inflight") {
+        size_t bytes;
+        if (!parseMemorySize(value, bytes)) {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'client-max-inflight'";
+            return false;
+        }
+        server_config.client_max_inflight = bytes;
+        return true;
+    }
+
+    if (param == "shed-latency-ms") {
+        int ms;
+        if (!parseInt(value, 0, 60000, ms)) {
+            err = "ERR Invalid argument '" + value + "' for CONFIG SET 'shed-latency-ms'";
+            return false;
+        }
+        server_config.shed_latency_ms = ms;
+        return true;
+    }
+
+    if (param == "capture-dir") {
+        if (!at_startup) {
+            err = "ERR CONFIG SET failed (possibly related to argument 'capture-dir') - can't set immutable config";
+            return false;
+        }
+        return setCaptureDir(value, err);
+    }
+
+    if (param == "capture-file") {
+        // A file name starts (or restarts) a capture; an empty value stops it
+        return setCaptureFile(value, err);
+    }
+
+    err = "ERR Unknown option or number of arguments for CONFIG SET - '" + name + "'";
+    return false;
+}
+
+bool getConfig(const std::string& name, std::string& value) {
+    std::string param = toLower(name);
+
+    if (param == "maxmemory") {
+        value = std::to_string(server_config.maxmemory.load());
+        return true;
+    }
+
+    if (param == "maxmemory-policy") {
+        value = server_config.maxmemory_policy == MaxMemoryPolicy::NoEviction
+            ? "noeviction" : "trim-oldest";
+        return true;
+    }
+
+    if (param == "io-threads") {
+        value = std::to_string(server_config.io_threads.load());
+        return true;
+    }
+
+    if (param == "io-backend") {
+        value = server_config.io_backend == IOBackend::Epoll ? "epoll" : "io_uring";
+        return true;
+    }
+
+    if (param == "client-output-buffer-limit") {
+        value = std::to_string(server_config.client_obuf_hard.load()) + " " +
+                std::to_string(server_config.client_obuf_soft.load()) + " " +
+                std::to_string(server_config.client_obuf_soft_seconds.load());
+        return true;
+    }
+
+    if (param == "hz") {
+        value = std::to_string(server_config.hz.load());
+        return true;
+    }
+
+    if (param == "active-expire-budget-us") {
+        value = std::to_string(server_config.active_expire_budget_us.load());
+        return true;
+    }
+
+    if (param == "maxclients") {
+        value = std::to_string(server_config.maxclients.load());
+        return true;
+    }
+
+    if (param == "tcp-backlog") {
+        value = std::to_string(server_config.tcp_backlog.load());
+        return true;
+    }
+
+    if (param == "client-command-rate") {
+        value = std::to_string(server_config.client_command_rate.load());
+        return true;
+    }
+
+    if (param == "client-max-inflight") {
+        value = std::to_string(server_config.client_max_inflight.load());
+        return true;
+    }
+
+    if (param == "shed-latency-ms") {
+        value = std::to_string(server_config.shed_latency_ms.load());
+        return true;
+    }
+
+    if (param == "capture-dir") {
+        value = captureDir();
+        return true;
+    }
+
+    if (param == "capture-file") {
+        value = captureFile();
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<std::string> configNames() {
+    return {"maxmemory", "maxmemory-policy", "io-threads", "io-backend",
+            "client-output-buffer-limit", "hz", "active-expire-budget-us", "maxclients", "tcp-backlog",
+            "client-command-rate", "client-max-inflight", "shed-latency-ms", "capture-dir", "capture-file"};
+}
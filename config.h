@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+enum class MaxMemoryPolicy { NoEviction, TrimOldest };
+enum class IOBackend { Epoll, IoUring };
+
+// Runtime-tunable server settings. Fields are atomic because they are read
+// by client threads while CONFIG SET may change them.
+struct ServerConfig {
+    std::atomic<size_t> maxmemory{0};  // 0 means no limit
+    std::atomic<MaxMemoryPolicy> maxmemory_policy{MaxMemoryPolicy::NoEviction};
+
+    // Event loop threads and the I/O mechanism they use; startup only
+    std::atomic<int> io_threads{4};
+    std::atomic<IOBackend> io_backend{IOBackend::Epoll};
+
+    // Per-client reply buffer limits. A client is disconnected as soon as its
+    // pending output exceeds the hard limit, or stays above the soft limit for
+    // soft_seconds. A limit of 0 disables it.
+    std::atomic<size_t> client_obuf_hard{256 * 1024 * 1024};
+    std::atomic<size_t> client_obuf_soft{64 * 1024 * 1024};
+    std::atomic<int> client_obuf_soft_seconds{60};
+
+    // Background tasks run hz times per second; each active expiry tick may
+    // spend at most active_expire_budget_us holding the write lock
+    std::atomic<int> hz{10};
+    std::atomic<int> active_expire_budget_us{1000};
+
+    // Admission control: connections beyond maxclients are refused as soon
+    // as they are accepted; tcp_backlog is the listen queue (startup only)
+    std::atomic<int> maxclients{10000};
+    std::atomic<int> tcp_backlog{511};
+
+    // Per-client limits, 0 disables: commands per second, and bytes of
+    // unsent replies before the client's commands stop being run and read
+    std::atomic<int> client_command_rate{0};
+    std::atomic<size_t> client_max_inflight{0};
+
+    // An event loop whose commands wait longer than this before they run
+    // refuses writes and new connections until it catches up; 0 disables
+    std::atomic<int> shed_latency_ms{0};
+};
+
+extern ServerConfig server_config;
+
+// Set a parameter by name, e.g. ("maxmemory", "100mb"). On failure returns
+// false and fills err with a RESP-ready error message. Startup-only
+// parameters are rejected unless at_startup is set.
+bool setConfig(const std::string& name, const std::string& value, std::string& err,
+               bool at_startup = false);
+
+// Get the current value of a parameter; returns false for unknown names
+bool getConfig(const std::string& name, std::string& value);
+
+// Names of all known parameters (for CONFIG GET *)
+std::vector<std::string> configNames();
+
+// Parse sizes such as "1024", "64kb", "100mb" or "2gb"
+bool parseMemorySize(const std::string& str, size_t& bytes);
@@ -0,0 +1,119 @@
+#include "epoch.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+// One record per thread that has ever entered a critical section. Records
+// are never freed, only recycled, so the list can be walked without locks.
+struct EpochRecord {
+    std::atomic<uint64_t> epoch;  // 0 while the thread is outside a guard
+    std::atomic<bool> in_use;
+    EpochRecord* next;
+};
+
+struct Retired {
+    void* ptr;
+    void (*deleter)(void*);
+    uint64_t epoch;
+};
+
+static std::atomic<EpochRecord*> records(nullptr);
+static std::atomic<uint64_t> global_epoch(1);
+
+static std::mutex retired_mutex;
+static std::vector<Retired> retired;
+
+// Per-thread binding to a record; guards may nest
+struct ThreadEpoch {
+    EpochRecord* record = nullptr;
+    int depth = 0;
+
+    ~ThreadEpoch() {
+        if (record) record->in_use.store(false, std::memory_order_release);
+    }
+};
+
+static thread_local ThreadEpoch thread_epoch;
+
+static EpochRecord* acquireRecord() {
+    for (EpochRecord* r = records.load(std::memory_order_acquire); r; r = r->next) {
+        bool expected = false;
+        if (!r->in_use.load(std::memory_order_relaxed) &&
+            r->in_use.compare_exchange_strong(expected, true)) {
+            return r;
+        }
+    }
+
+    EpochRecord* r = new EpochRecord;
+    r->epoch.store(0, std::memory_order_relaxed);
+    r->in_use.store(true, std::memory_order_relaxed);
+    r->next = records.load(std::memory_order_relaxed);
+    while (!records.compare_exchange_weak(r->next, r, std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+    }
+    return r;
+}
+
+EpochGuard::EpochGuard() {
+    ThreadEpoch& te = thread_epoch;
+    if (te.depth++ > 0) return;
+    if (!te.record) te.record = acquireRecord();
+
+    // Announce the epoch before touching any shared pointer
+    te.record->epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+EpochGuard::~EpochGuard() {
+    ThreadEpoch& te = thread_epoch;
+    if (--te.depth > 0) return;
+    te.record->epoch.store(0, std::memory_order_release);
+}
+
+// Move the global epoch forward if every active reader has caught up with it
+static void tryAdvance() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t current = global_epoch.load(std::memory_order_seq_cst);
+
+    for (EpochRecord* r = records.load(std::memory_order_acquire); r; r = r->next) {
+        if (!r->in_use.load(std::memory_order_acquire)) continue;
+        uint64_t e = r->epoch.load(std::memory_order_seq_cst);
+        if (e != 0 && e != current) return;
+    }
+    global_epoch.compare_exchange_strong(current, current + 1);
+}
+
+void epochRetire(void* ptr, void (*deleter)(void*)) {
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex);
+        retired.push_back(Retired{ptr, deleter, global_epoch.load(std::memory_order_seq_cst)});
+
+        // Two steps let this very object be freed right away when no reader
+        // is inside a guard
+        tryAdvance();
+        tryAdvance();
+
+        // Anything retired two epochs ago can no longer be referenced
+        uint64_t current = global_epoch.load(std::memory_order_seq_cst);
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); ++i) {
+            if (retired[i].epoch + 2 <= current) {
+                ready.push_back(retired[i]);
+            } else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+    }
+
+    for (const auto& r : ready) {
+        r.deleter(r.ptr);
+    }
+}
+
+size_t epochPendingCount() {
+    std::lock_guard<std::mutex> lock(retired_mutex);
+    return retired.size();
+}
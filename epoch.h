@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Epoch-based reclamation for structures that readers traverse without
+// taking a lock. A reader wraps its traversal in an EpochGuard; a writer that
+// unlinks a node hands it to epochRetire() instead of freeing it, and the
+// node is only destroyed once every reader that might still see it has left
+// its critical section.
+class EpochGuard {
+public:
+    EpochGuard();
+    ~EpochGuard();
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+// Defer deleter(ptr) until no EpochGuard that could observe ptr is active.
+// ptr must already be unreachable for readers that start after this call.
+void epochRetire(void* ptr, void (*deleter)(void*));
+
+// Number of retired objects not yet freed
+size_t epochPendingCount();
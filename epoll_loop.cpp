@@ -0,0 +1,252 @@
+#include "epoll_loop.h"
+#include "capture.h"
+#include <iostream>
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+constexpr int MAX_EVENTS = 256;
+
+EpollLoop::EpollLoop(int listen_sock) : listen_fd(listen_sock) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        throw std::runtime_error("epoll_create1 failed");
+    }
+
+    // Several loops may race for each connection, so accept must not block
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // EPOLLEXCLUSIVE wakes only one of the loops per incoming connection
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.fd = listen_fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        close(epfd);
+        throw std::runtime_error("epoll_ctl failed for listening socket");
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = mailbox.fd();
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, mailbox.fd(), &ev) < 0) {
+        close(epfd);
+        throw std::runtime_error("epoll_ctl failed for push mailbox");
+    }
+}
+
+EpollLoop::~EpollLoop() {
+    while (!clients.empty()) {
+        freeClient(*clients.begin()->second);
+    }
+    close(epfd);
+}
+
+void EpollLoop::run() {
+    epoll_event events[MAX_EVENTS];
+
+    while (true) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("epoll_wait failed");
+        }
+
+        load.batchStarted();
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                acceptClients();
+                continue;
+            }
+            if (fd == mailbox.fd()) {
+                deliverPushes();
+                continue;
+            }
+
+            // The client may have been freed earlier in this batch
+            auto it = clients.find(fd);
+            if (it == clients.end()) continue;
+            Client& c = *it->second;
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                freeClient(c);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                writeToClient(c);
+                if (clients.find(fd) == clients.end()) continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                readFromClient(c);
+            }
+        }
+        load.batchFinished();
+    }
+}
+
+void EpollLoop::acceptClients() {
+    while (true) {
+        sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int client_sock = accept4(listen_fd, (sockaddr*)&client_addr, &client_len,
+                                  SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_sock < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Accept failed." << std::endl;
+            }
+            return;
+        }
+        if (!admitClient(client_sock, load)) continue;
+
+        int opt = 1;
+        setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &(client_addr.sin_addr), client_ip, INET_ADDRSTRLEN);
+        std::string addr = std::string(client_ip) + ":" + std::to_string(ntohs(client_addr.sin_port));
+
+        // Created first so a failure below gives the maxclients slot back
+        std::unique_ptr<Client> c(new Client(client_sock, addr));
+        c->mailbox = &mailbox;
+        c->load = &load;
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = client_sock;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, client_sock, &ev) < 0) {
+            std::cerr << "epoll_ctl failed for client " << addr << std::endl;
+            close(client_sock);
+            continue;
+        }
+
+        clients[client_sock] = std::move(c);
+        std::cout << "Client connected: " << addr << std::endl;
+    }
+}
+
+void EpollLoop::deliverPushes() {
+    for (Client* c : mailbox.deliver()) {
+        handleClientOutput(*c);
+    }
+}
+
+void EpollLoop::readFromClient(Client& c) {
+    size_t old_size = c.querybuf.size();
+    c.querybuf.resize(old_size + READ_CHUNK);
+
+    ssize_t n = read(c.fd, &c.querybuf[old_size], READ_CHUNK);
+    if (n <= 0) {
+        c.querybuf.resize(old_size);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+        freeClient(c);
+        return;
+    }
+    c.querybuf.resize(old_size + n);
+
+    if (!checkQueryBufferLimits(c)) {
+        freeClient(c);
+        return;
+    }
+
+    processInputBuffer(c);
+    handleClientOutput(c);
+}
+
+void EpollLoop::writeToClient(Client& c) {
+    if (c.reply.writeTo(c.fd) < 0) {
+        freeClient(c);
+        return;
+    }
+    if (!checkOutputBufferLimits(c)) {
+        freeClient(c);
+        return;
+    }
+
+    resumeClient(c);
+    if (c.close_asap) {
+        freeClient(c);
+        return;
+    }
+
+    if (c.reply.empty()) {
+        if (c.close_after_reply) {
+            freeClient(c);
+            return;
+        }
+        setWantWrite(c, false);
+    }
+    updateReading(c);
+}
+
+void EpollLoop::handleClientOutput(Client& c) {
+    if (c.close_asap) {
+        freeClient(c);
+        return;
+    }
+
+    // Write directly while the socket has room; only fall back to EPOLLOUT
+    // once the kernel buffer is full
+    if (!c.reply.empty() && !c.want_write) {
+        if (c.reply.writeTo(c.fd) < 0) {
+            freeClient(c);
+            return;
+        }
+
+        // More of a range reply goes out once EPOLLOUT reports room for it
+        resumeClient(c);
+        if (c.close_asap) {
+            freeClient(c);
+            return;
+        }
+    }
+
+    if (c.reply.empty()) {
+        if (c.close_after_reply) {
+            freeClient(c);
+            return;
+        }
+    } else {
+        setWantWrite(c, true);
+    }
+    updateReading(c);
+}
+
+void EpollLoop::setWantWrite(Client& c, bool enable) {
+    if (c.want_write == enable) return;
+    c.want_write = enable;
+    updateEvents(c);
+}
+
+void EpollLoop::updateReading(Client& c) {
+    bool pause = readPaused(c);
+    if (c.read_paused == pause) return;
+    c.read_paused = pause;
+    updateEvents(c);
+}
+
+void EpollLoop::updateEvents(Client& c) {
+    epoll_event ev;
+    ev.events = 0;
+    if (!c.read_paused) ev.events |= EPOLLIN;
+    if (c.want_write) ev.events |= EPOLLOUT;
+    ev.data.fd = c.fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+void EpollLoop::freeClient(Client& c) {
+    int fd = c.fd;
+    unsubscribeAll(c);
+    if (capture_enabled.load(std::memory_order_relaxed)) {
+        captureDisconnect(c.id);
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    std::cout << "Client connection closed: " << c.addr << std::endl;
+    clients.erase(fd);
+}
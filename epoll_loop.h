@@ -0,0 +1,34 @@
+#pragma once
+#include "event_loop.h"
+#include "networking.h"
+#include "pubsub.h"
+#include <map>
+#include <memory>
+
+// Readiness-based backend: level-triggered epoll with direct read/writev
+class EpollLoop : public EventLoop {
+public:
+    explicit EpollLoop(int listen_fd);
+    ~EpollLoop() override;
+
+    void run() override;
+
+private:
+    int epfd;
+    int listen_fd;
+    std::map<int, std::unique_ptr<Client>> clients;
+    PushMailbox mailbox;  // New entries for streams our clients tail
+    LoadMonitor load;  // Queue delay, for load shedding
+
+    void acceptClients();
+    void deliverPushes();
+    void readFromClient(Client& c);
+    void writeToClient(Client& c);
+
+    // Flush what we can right away and watch for writability if needed
+    void handleClientOutput(Client& c);
+    void setWantWrite(Client& c, bool enable);
+    void updateReading(Client& c);
+    void updateEvents(Client& c);
+    void freeClient(Client& c);
+};
@@ -0,0 +1,18 @@
+#include "event_loop.h"
+#include "epoll_loop.h"
+#include "uring_loop.h"
+#include "config.h"
+#include <iostream>
+#include <stdexcept>
+
+std::unique_ptr<EventLoop> createEventLoop(int listen_fd) {
+    if (server_config.io_backend == IOBackend::IoUring) {
+        try {
+            return std::unique_ptr<EventLoop>(new UringLoop(listen_fd));
+        } catch (const std::exception& e) {
+            std::cerr << "io_uring unavailable (" << e.what() << "), falling back to epoll" << std::endl;
+            server_config.io_backend = IOBackend::Epoll;
+        }
+    }
+    return std::unique_ptr<EventLoop>(new EpollLoop(listen_fd));
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <memory>
+
+// An I/O backend driving a set of clients on one thread. The server runs
+// io-threads of these; each accepts from the shared listening socket and
+// owns the clients it accepted.
+class EventLoop {
+public:
+    EventLoop() {}
+    virtual ~EventLoop() {}
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Process events forever
+    virtual void run() = 0;
+};
+
+// Create a loop for the configured io-backend, falling back to epoll if
+// io_uring isn't available on this kernel
+std::unique_ptr<EventLoop> createEventLoop(int listen_fd);
@@ -0,0 +1,95 @@
+#include "expire.h"
+#include "commands.h"
+#include "config.h"
+#include "memory.h"
+#include "partition.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Entries expired per call into a stream before the clock is checked again
+constexpr size_t EXPIRE_BATCH = 64;
+
+// Streams without a retention policy are cheap to skip; check the clock
+// after visiting this many of them
+constexpr size_t KEYS_PER_CLOCK_CHECK = 16;
+
+static std::atomic<uint64_t> expired_total(0);
+
+// Where the next tick resumes: a keyspace SCAN cursor, plus how many keys
+// of that bucket the last tick already finished when it ran out of time
+static uint64_t cursor = 0;
+static size_t bucket_done = 0;
+
+size_t activeExpireCycle(uint64_t now_ms, uint64_t budget_us) {
+    if (streams.empty()) {
+        return 0;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget_us);
+    size_t expired = 0;
+    size_t visited = 0;
+    bool out_of_time = false;
+
+    // Walk the keyspace until the cursor wraps, so each key is visited at
+    // most once per tick
+    do {
+        size_t index = 0;
+        uint64_t next = streams.scan(cursor, [&](const std::string&, Stream& stream) {
+            if (out_of_time || index++ < bucket_done) return;
+
+            uint64_t retention = stream.retention();
+            if (retention > 0 && now_ms > retention) {
+                size_t n;
+                PartitionedStream* parts = stream.partitions();
+                do {
+                    n = parts ? parts->expireBefore(now_ms - retention, EXPIRE_BATCH)
+                              : stream.expireBefore(now_ms - retention, EXPIRE_BATCH);
+                    expired += n;
+                    if (std::chrono::steady_clock::now() >= deadline) {
+                        // Out of budget: finish this stream next tick if needed
+                        out_of_time = true;
+                        bucket_done = n == EXPIRE_BATCH ? index - 1 : index;
+                        return;
+                    }
+                } while (n == EXPIRE_BATCH);
+            } else if (++visited % KEYS_PER_CLOCK_CHECK == 0 &&
+                       std::chrono::steady_clock::now() >= deadline) {
+                out_of_time = true;
+                bucket_done = index;
+            }
+        });
+        if (out_of_time) break;
+
+        cursor = next;
+        bucket_done = 0;
+    } while (cursor != 0);
+
+    expired_total += expired;
+    return expired;
+}
+
+void startActiveExpire() {
+    std::thread([] {
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000 / server_config.hz));
+
+            // Entry IDs carry wall-clock milliseconds
+            uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+            std::lock_guard<std::mutex> lock(write_mutex);
+            activeExpireCycle(now_ms, server_config.active_expire_budget_us);
+            rehashKeyspace();
+
+            // XPADD runs without the write lock and so can't evict for itself
+            freeMemoryIfNeeded();
+        }
+    }).detach();
+}
+
+uint64_t expiredEntriesTotal() {
+    return expired_total;
+}
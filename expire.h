@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Active expiry of entries older than their stream's retention. Each tick
+// resumes where the previous one stopped, so a large keyspace is covered
+// over several ticks instead of stalling writers in one long pass.
+
+// Run one tick with a time budget in microseconds. Caller must hold the
+// command write lock. Returns the number of entries expired.
+size_t activeExpireCycle(uint64_t now_ms, uint64_t budget_us);
+
+// Start the background thread that runs a tick hz times per second
+void startActiveExpire();
+
+// Entries expired since startup
+uint64_t expiredEntriesTotal();
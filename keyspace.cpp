@@ -0,0 +1,253 @@
+#include "keyspace.h"
+#include "memory.h"
+#include <algorithm>
+#include <functional>
+
+constexpr uint64_t Keyspace::EMPTY;
+constexpr uint64_t Keyspace::TOMBSTONE;
+constexpr size_t Keyspace::NOT_FOUND;
+constexpr size_t Keyspace::NOT_REHASHING;
+
+constexpr size_t INITIAL_CAPACITY = 16;
+
+// Slots of an in-progress resize migrated by each insert or delete. With
+// resizes triggered at 3/4 full into a table at most half full, migration
+// always ends well before the new table fills up.
+constexpr size_t REHASH_SLOTS = 16;
+
+void Keyspace::Table::reset(size_t cap) {
+    hashes.assign(cap, EMPTY);
+    slots.clear();
+    slots.resize(cap);
+    mask = cap - 1;
+    used = 0;
+    filled = 0;
+}
+
+size_t Keyspace::Table::indexOf(uint64_t hash, const std::string& key) const {
+    // There is always an empty slot, so the probe terminates
+    for (size_t i = hash & mask; hashes[i] != EMPTY; i = (i + 1) & mask) {
+        if (hashes[i] == hash && slots[i].key == key) {
+            return i;
+        }
+    }
+    return NOT_FOUND;
+}
+
+void Keyspace::Table::place(uint64_t hash, Slot&& slot) {
+    size_t i = hash & mask;
+    while (hashes[i] > TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    if (hashes[i] == EMPTY) {
+        ++filled;
+    }
+    hashes[i] = hash;
+    slots[i] = std::move(slot);
+    ++used;
+}
+
+void Keyspace::Table::remove(size_t index) {
+    slots[index] = Slot();
+    hashes[index] = TOMBSTONE;
+    --used;
+
+    // A tombstone right before an empty slot ends every probe that reaches
+    // it anyway, so it (and any tombstones before it) can become empty
+    size_t i = index;
+    while (hashes[(i + 1) & mask] == EMPTY && hashes[i] == TOMBSTONE) {
+        hashes[i] = EMPTY;
+        --filled;
+        i = (i - 1) & mask;
+    }
+}
+
+Keyspace::Keyspace() : rehash_idx(NOT_REHASHING) {
+    tables[0].reset(INITIAL_CAPACITY);
+}
+
+uint64_t Keyspace::hashKey(const std::string& key) {
+    uint64_t hash = std::hash<std::string>()(key);
+    return hash > TOMBSTONE ? hash : hash + 2;
+}
+
+size_t Keyspace::capacityFor(size_t keys) {
+    size_t cap = INITIAL_CAPACITY;
+    while (cap < keys * 2) {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+Stream* Keyspace::find(const std::string& key) const {
+    uint64_t hash = hashKey(key);
+    for (const Table& table : tables) {
+        if (table.used == 0) continue;
+        size_t i = table.indexOf(hash, key);
+        if (i != NOT_FOUND) {
+            return table.slots[i].stream.get();
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<Stream> Keyspace::findShared(const std::string& key) const {
+    uint64_t hash = hashKey(key);
+    for (const Table& table : tables) {
+        if (table.used == 0) continue;
+        size_t i = table.indexOf(hash, key);
+        if (i != NOT_FOUND) {
+            return table.slots[i].stream;
+        }
+    }
+    return nullptr;
+}
+
+Stream* Keyspace::insert(const std::string& key, std::shared_ptr<Stream> stream) {
+    rehashStep(REHASH_SLOTS);
+
+    // New keys go to the table being migrated into, if any
+    Table* target = &tables[rehashing() ? 1 : 0];
+    if ((target->filled + 1) * 4 > target->capacity() * 3) {
+        // Only reachable mid-resize under a burst of inserts: finish it first
+        rehashStep(tables[0].capacity());
+        startResize(capacityFor(size() + 1));
+        target = &tables[1];
+    }
+
+    Stream* raw = stream.get();
+    Slot slot;
+    slot.key = key;
+    slot.stream = std::move(stream);
+    target->place(hashKey(key), std::move(slot));
+    return raw;
+}
+
+bool Keyspace::erase(const std::string& key) {
+    rehashStep(REHASH_SLOTS);
+
+    uint64_t hash = hashKey(key);
+    for (Table& table : tables) {
+        if (table.used == 0) continue;
+        size_t i = table.indexOf(hash, key);
+        if (i == NOT_FOUND) continue;
+
+        table.remove(i);
+
+        // Give memory back once the table is mostly empty
+        if (!rehashing() && tables[0].capacity() > INITIAL_CAPACITY &&
+            tables[0].used * 8 < tables[0].capacity()) {
+            startResize(capacityFor(tables[0].used));
+        }
+        return true;
+    }
+    return false;
+}
+
+void Keyspace::startResize(size_t capacity) {
+    tables[1].reset(capacity);
+    rehash_idx = 0;
+}
+
+void Keyspace::rehashStep(size_t slots) {
+    if (!rehashing()) return;
+
+    Table& from = tables[0];
+    Table& to = tables[1];
+    for (size_t n = 0; n < slots && rehash_idx < from.capacity(); ++n, ++rehash_idx) {
+        // Leave a tombstone: probes in the old table must still pass through
+        if (from.hashes[rehash_idx] > TOMBSTONE) {
+            to.place(from.hashes[rehash_idx], std::move(from.slots[rehash_idx]));
+            from.slots[rehash_idx] = Slot();
+            from.hashes[rehash_idx] = TOMBSTONE;
+            --from.used;
+        }
+    }
+
+    if (rehash_idx == from.capacity()) {
+        finishResize();
+    }
+}
+
+void Keyspace::finishResize() {
+    std::swap(tables[0], tables[1]);
+    tables[1] = Table();
+    rehash_idx = NOT_REHASHING;
+}
+
+size_t Keyspace::keyOverhead(const std::string& key) {
+    return sizeof(Slot) + sizeof(uint64_t) + stringAllocSize(key);
+}
+
+// Match c against the class starting at pattern[p] == '['; next is set to
+// the index after its closing ']' (an unclosed class runs to the end)
+static bool matchClass(const std::string& pattern, size_t p, char c, size_t& next) {
+    size_t i = p + 1;
+    bool negate = i < pattern.size() && pattern[i] == '^';
+    if (negate) ++i;
+
+    bool match = false;
+    while (i < pattern.size() && pattern[i] != ']') {
+        if (pattern[i] == '\\' && i + 1 < pattern.size()) {
+            match |= pattern[i + 1] == c;
+            i += 2;
+        } else if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+            char lo = std::min(pattern[i], pattern[i + 2]);
+            char hi = std::max(pattern[i], pattern[i + 2]);
+            match |= c >= lo && c <= hi;
+            i += 3;
+        } else {
+            match |= pattern[i] == c;
+            ++i;
+        }
+    }
+    next = i < pattern.size() ? i + 1 : i;
+    return match != negate;
+}
+
+bool globMatch(const std::string& pattern, const std::string& str) {
+    // Greedy with backtracking to the most recent '*'
+    size_t p = 0;
+    size_t s = 0;
+    size_t star_p = std::string::npos;
+    size_t star_s = 0;
+
+    while (s < str.size()) {
+        if (p < pattern.size()) {
+            char pc = pattern[p];
+            if (pc == '*') {
+                star_p = ++p;
+                star_s = s;
+                continue;
+            }
+
+            size_t next = p + 1;
+            bool match;
+            if (pc == '?') {
+                match = true;
+            } else if (pc == '[') {
+                match = matchClass(pattern, p, str[s], next);
+            } else {
+                if (pc == '\\' && p + 1 < pattern.size()) {
+                    pc = pattern[p + 1];
+                    next = p + 2;
+                }
+                match = pc == str[s];
+            }
+            if (match) {
+                p = next;
+                ++s;
+                continue;
+            }
+        }
+
+        if (star_p == std::string::npos) return false;
+        p = star_p;
+        s = ++star_s;
+    }
+
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include "stream.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+// Glob-style match as in KEYS/SCAN MATCH: * ? [abc] [^a-z] and backslash escapes
+bool globMatch(const std::string& pattern, const std::string& str);
+
+// Key name -> stream, as an open-addressing hash table with linear probing.
+//
+// Each table keeps the hashes of its slots in a dense array of their own, so
+// a probe walks consecutive 8-byte words and only compares key strings on a
+// full hash match. Growing (or compacting after many deletes) allocates a new
+// table and migrates the old one a few slots at a time from later inserts,
+// deletes and the background tick, so no single command pays for a whole
+// resize. Until migration ends, lookups check both tables.
+//
+// Not synchronized: callers provide the locking (see commands.cpp).
+class Keyspace {
+public:
+    Keyspace();
+    Keyspace(const Keyspace&) = delete;
+    Keyspace& operator=(const Keyspace&) = delete;
+
+    // nullptr if key is absent
+    Stream* find(const std::string& key) const;
+    std::shared_ptr<Stream> findShared(const std::string& key) const;
+
+    // Add a key that is not present yet; returns its stream
+    Stream* insert(const std::string& key, std::shared_ptr<Stream> stream);
+
+    // Returns false if key was absent
+    bool erase(const std::string& key);
+
+    size_t size() const { return tables[0].used + tables[1].used; }
+    bool empty() const { return size() == 0; }
+
+    // Visit every key as fn(key, stream)
+    template <typename Fn>
+    void forEach(Fn fn) const;
+
+    // Visit the keys under one SCAN cursor as fn(key, stream) and return the
+    // next cursor, 0 once the whole keyspace has been covered. A key present
+    // for the whole scan is visited at least once even if the table resizes
+    // in between; keys may be visited more than once.
+    template <typename Fn>
+    uint64_t scan(uint64_t cursor, Fn fn) const;
+
+    // Migrate up to slots slots of an in-progress resize
+    bool rehashing() const { return rehash_idx != NOT_REHASHING; }
+    void rehashStep(size_t slots);
+
+    // Bytes a key costs the table: its slot, stored hash and name
+    static size_t keyOverhead(const std::string& key);
+
+private:
+    // Reserved hash values; real hashes are remapped above them
+    static constexpr uint64_t EMPTY = 0;
+    static constexpr uint64_t TOMBSTONE = 1;
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+    static constexpr size_t NOT_REHASHING = static_cast<size_t>(-1);
+
+    struct Slot {
+        std::string key;
+        std::shared_ptr<Stream> stream;
+    };
+
+    struct Table {
+        std::vector<uint64_t> hashes;  // EMPTY, TOMBSTONE or the key's hash
+        std::vector<Slot> slots;
+        size_t mask = 0;
+        size_t used = 0;  // Live keys
+        size_t filled = 0;  // Live keys plus tombstones
+
+        size_t capacity() const { return hashes.size(); }
+        void reset(size_t capacity);
+        size_t indexOf(uint64_t hash, const std::string& key) const;  // Or NOT_FOUND
+        void place(uint64_t hash, Slot&& slot);  // Into the first free slot of its run
+        void remove(size_t index);
+
+        // Visit live keys whose home slot is bucket: they all sit in the
+        // run of non-empty slots starting there
+        template <typename Fn>
+        void visitBucket(size_t bucket, Fn& fn) const;
+    };
+
+    // tables[1] only holds keys while a resize migrates tables[0] into it
+    Table tables[2];
+    size_t rehash_idx;  // Next tables[0] slot to migrate
+
+    static uint64_t hashKey(const std::string& key);
+    static size_t capacityFor(size_t keys);
+    void startResize(size_t capacity);
+    void finishResize();
+};
+
+template <typename Fn>
+void Keyspace::Table::visitBucket(size_t bucket, Fn& fn) const {
+    for (size_t i = bucket; hashes[i] != EMPTY; i = (i + 1) & mask) {
+        if (hashes[i] != TOMBSTONE && (hashes[i] & mask) == bucket) {
+            fn(slots[i].key, *slots[i].stream);
+        }
+    }
+}
+
+template <typename Fn>
+void Keyspace::forEach(Fn fn) const {
+    for (const Table& table : tables) {
+        for (size_t i = 0; i < table.capacity(); ++i) {
+            if (table.hashes[i] > TOMBSTONE) {
+                fn(table.slots[i].key, *table.slots[i].stream);
+            }
+        }
+    }
+}
+
+// Reverse-binary cursor, as in Redis's dictScan: the high bits of the
+// cursor are incremented first, so buckets already visited in a smaller
+// table map to buckets already visited in a larger one and vice versa.
+static inline uint64_t reverseBits(uint64_t v) {
+    uint64_t r = 0;
+    for (int i = 0; i < 64; ++i) {
+        r = (r << 1) | (v & 1);
+        v >>= 1;
+    }
+    return r;
+}
+
+template <typename Fn>
+uint64_t Keyspace::scan(uint64_t cursor, Fn fn) const {
+    if (empty()) return 0;
+
+    uint64_t v = cursor;
+    if (!rehashing()) {
+        const Table& t = tables[0];
+        t.visitBucket(v & t.mask, fn);
+        v |= ~static_cast<uint64_t>(t.mask);
+        v = reverseBits(reverseBits(v) + 1);
+        return v;
+    }
+
+    const Table* small = &tables[0];
+    const Table* large = &tables[1];
+    if (small->mask > large->mask) std::swap(small, large);
+    uint64_t m0 = small->mask;
+    uint64_t m1 = large->mask;
+
+    // The small table's bucket, then every large-table bucket it expands to
+    small->visitBucket(v & m0, fn);
+    do {
+        large->visitBucket(v & m1, fn);
+        v |= ~m1;
+        v = reverseBits(reverseBits(v) + 1);
+    } while (v & (m0 ^ m1));
+    return v;
+}
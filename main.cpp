@@ -1,62 +1,42 @@
 #include <iostream>
 #include <thread>
 #include <vector>
+#include <memory>
 #include <cstring>
+#include <csignal>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include "resp_parser.h"
-#include "commands.h"
+#include "config.h"
+#include "event_loop.h"
+#include "expire.h"
 
 constexpr int PORT = 6380;
-constexpr int BACKLOG = 10;
 
-void handle_client(int client_sock, sockaddr_in client_addr) {
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &(client_addr.sin_addr), client_ip, INET_ADDRSTRLEN);
-    std::cout << "Client connected: " << client_ip << ":" << ntohs(client_addr.sin_port) << std::endl;
-    
-    while (true) {
-        try {
-            std::cout << "DEBUG: Starting to parse command..." << std::endl;
-            // Parse the incoming command
-            RESPValue command = parseRESP(client_sock);
-            std::cout << "DEBUG: Command parsed successfully" << std::endl;
-            
-            // Check for QUIT command
-            if (command.type == RESPType::Array && !command.array.empty() && 
-                command.array[0].str == "QUIT") {
-                std::cout << "DEBUG: Client requested QUIT" << std::endl;
-                break;
-            }
-            
-            // Handle the command and get response
-            RESPValue response = handleCommand(command);
-            std::cout << "DEBUG: Command handled, sending response..." << std::endl;
-            std::string resp_str = serializeRESP(response);
-            write(client_sock, resp_str.c_str(), resp_str.size());
-            std::cout << "DEBUG: Response sent" << std::endl;
-            
-        } catch (const std::exception& e) {
-            std::cerr << "Error handling client: " << e.what() << std::endl;
-            // Send error response
-            RESPValue error(RESPType::Error, "Error: " + std::string(e.what()));
-            std::string error_str = serializeRESP(error);
-            write(client_sock, error_str.c_str(), error_str.size());
-            
-            // If it's a parsing error, break the loop
-            if (std::string(e.what()).find("Failed to read") != std::string::npos) {
-                break;
-            }
+// Apply "--name value" pairs from the command line to the server config
+static bool parseArgs(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0 || i + 1 >= argc) {
+            std::cerr << "Usage: " << argv[0] << " [--<config-name> <value> ...]" << std::endl;
+            return false;
+        }
+
+        std::string err;
+        if (!setConfig(arg.substr(2), argv[++i], err, true)) {
+            std::cerr << err << std::endl;
+            return false;
         }
     }
-    
-    close(client_sock);
-    std::cout << "DEBUG: Client connection closed" << std::endl;
+    return true;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (!parseArgs(argc, argv)) {
+        return 1;
+    }
+
     int server_sock = socket(AF_INET, SOCK_STREAM, 0);
     if (server_sock < 0) {
         std::cerr << "Failed to create socket." << std::endl;
@@ -82,30 +62,45 @@ int main() {
         return 1;
     }
 
-    if (listen(server_sock, BACKLOG) < 0) {
+    // The kernel caps the queue at net.core.somaxconn
+    if (listen(server_sock, server_config.tcp_backlog) < 0) {
         std::cerr << "Listen failed." << std::endl;
         close(server_sock);
         return 1;
     }
 
-    std::cout << "Server listening on port " << PORT << std::endl;
-    std::vector<std::thread> threads;
+    // A peer closing mid-reply must surface as EPIPE, not kill the server
+    signal(SIGPIPE, SIG_IGN);
 
-    while (true) {
-        sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_sock = accept(server_sock, (sockaddr*)&client_addr, &client_len);
-        if (client_sock < 0) {
-            std::cerr << "Accept failed." << std::endl;
-            continue;
+    std::vector<std::unique_ptr<EventLoop>> loops;
+    try {
+        for (int i = 0; i < server_config.io_threads; ++i) {
+            loops.push_back(createEventLoop(server_sock));
         }
-        threads.emplace_back(handle_client, client_sock, client_addr);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to create event loop: " << e.what() << std::endl;
+        close(server_sock);
+        return 1;
     }
 
-    // Cleanup (unreachable in this infinite loop, but good practice)
+    std::string backend;
+    getConfig("io-backend", backend);
+    std::cout << "Server listening on port " << PORT << " with "
+              << loops.size() << " " << backend << " I/O threads" << std::endl;
+
+    startActiveExpire();
+
+    // The main thread runs the first loop itself
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < loops.size(); ++i) {
+        threads.emplace_back(&EventLoop::run, loops[i].get());
+    }
+    loops[0]->run();
+
+    // Cleanup (unreachable while the loops run forever, but good practice)
     for (auto& t : threads) {
         if (t.joinable()) t.join();
     }
     close(server_sock);
     return 0;
-} 
\ No newline at end of file
+}
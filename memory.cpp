@@ -0,0 +1,91 @@
+#include "memory.h"
+#include "config.h"
+#include "commands.h"
+#include "partition.h"
+#include <atomic>
+#include <mutex>
+
+static std::atomic<size_t> used_memory(0);
+
+void memoryAdd(size_t bytes) {
+    used_memory.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void memorySub(size_t bytes) {
+    used_memory.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+size_t memoryUsed() {
+    return used_memory.load(std::memory_order_relaxed);
+}
+
+size_t stringAllocSize(const std::string& s) {
+    // libstdc++ keeps up to 15 characters inline
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;
+}
+
+bool freeMemoryIfNeeded() {
+    size_t limit = server_config.maxmemory;
+    if (limit == 0 || memoryUsed() <= limit) {
+        return true;
+    }
+
+    if (server_config.maxmemory_policy == MaxMemoryPolicy::NoEviction) {
+        return false;
+    }
+
+    // TrimOldest: evict from whichever stream holds the globally oldest
+    // entry. Finding the runner-up lets us evict a whole run from one stream
+    // per keyspace scan instead of rescanning after every entry.
+    while (memoryUsed() > limit) {
+        Stream* oldest = nullptr;
+        std::mutex* oldest_mutex = nullptr;  // Partition mutex, if oldest is a partition
+        StreamID oldest_id;
+        StreamID next_id;
+        bool have_next = false;
+
+        auto consider = [&](Stream& stream, std::mutex* mutex) {
+            if (stream.length() == 0) return;
+
+            StreamID first;
+            if (!StreamID::parse(stream.firstEntry().id, first)) return;
+
+            if (!oldest || first < oldest_id) {
+                if (oldest) {
+                    next_id = oldest_id;
+                    have_next = true;
+                }
+                oldest = &stream;
+                oldest_mutex = mutex;
+                oldest_id = first;
+            } else if (!have_next || first < next_id) {
+                next_id = first;
+                have_next = true;
+            }
+        };
+
+        streams.forEach([&](const std::string&, Stream& stream) {
+            PartitionedStream* parts = stream.partitions();
+            if (!parts) {
+                consider(stream, nullptr);
+                return;
+            }
+            for (size_t i = 0; i < parts->partitionCount(); ++i) {
+                std::lock_guard<std::mutex> lock(parts->partitionMutex(i));
+                consider(parts->partition(i), &parts->partitionMutex(i));
+            }
+        });
+
+        if (!oldest) {
+            return false; // Nothing left to evict
+        }
+
+        std::unique_lock<std::mutex> lock;
+        if (oldest_mutex) {
+            lock = std::unique_lock<std::mutex>(*oldest_mutex);
+        }
+        oldest->trimOldest(memoryUsed() - limit, have_next ? &next_id : nullptr);
+    }
+
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// Global accounting of bytes held by stream data. Streams report their
+// allocations here so maxmemory can be enforced without walking the keyspace.
+void memoryAdd(size_t bytes);
+void memorySub(size_t bytes);
+size_t memoryUsed();
+
+// Approximate heap footprint of a std::string's character buffer (zero when
+// the contents fit in the small-string buffer)
+size_t stringAllocSize(const std::string& s);
+
+// Approximate per-node overhead of a std::map (color + parent/left/right)
+constexpr size_t MAP_NODE_OVERHEAD = 32;
+
+// Bring memory usage back under maxmemory according to maxmemory-policy.
+// Returns false if the limit is still exceeded and writes must be refused.
+// Caller must hold the keyspace lock.
+bool freeMemoryIfNeeded();
@@ -0,0 +1,363 @@
+#include "networking.h"
+#include "commands.h"
+#include "config.h"
+#include "pubsub.h"
+#include "capture.h"
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <atomic>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+uint64_t nextClientId() {
+    static std::atomic<uint64_t> next_id(1);
+    return next_id++;
+}
+
+// Connected clients across all event loops (maxclients slots taken)
+static std::atomic<int> connected_clients(0);
+
+void LoadMonitor::batchStarted() {
+    batch_start = std::chrono::steady_clock::now();
+}
+
+void LoadMonitor::batchFinished() {
+    last_batch_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - batch_start).count();
+
+    // Stop only once well under the threshold, so a loop hovering around it
+    // doesn't flip (and log) on every batch
+    int64_t threshold_us = static_cast<int64_t>(server_config.shed_latency_ms) * 1000;
+    bool over = threshold_us > 0 && last_batch_us > threshold_us;
+    bool under = threshold_us == 0 || last_batch_us < threshold_us / 2;
+    if (!shedding && over) {
+        shedding = true;
+        std::cerr << "Event loop overloaded (commands waited " << last_batch_us / 1000
+                  << " ms): refusing writes and new connections" << std::endl;
+    } else if (shedding && under) {
+        shedding = false;
+        std::cerr << "Event loop caught up: accepting writes and new connections again" << std::endl;
+    }
+}
+
+bool LoadMonitor::overloaded() const {
+    int64_t threshold_us = static_cast<int64_t>(server_config.shed_latency_ms) * 1000;
+    if (threshold_us == 0) return false;
+    if (shedding || last_batch_us > threshold_us) return true;
+
+    int64_t waited_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - batch_start).count();
+    return waited_us > threshold_us;
+}
+
+Client::~Client() {
+    connected_clients--;
+}
+
+bool admitClient(int fd, const LoadMonitor& load) {
+    // Reserve first so concurrent accepts on other loops can't overshoot
+    const char* error = nullptr;
+    if (connected_clients.fetch_add(1) >= server_config.maxclients) {
+        error = "-ERR max number of clients reached\r\n";
+    } else if (load.overloaded()) {
+        error = "-BUSY server is overloaded, try again later\r\n";
+    }
+    if (!error) return true;
+
+    // Refused before any per-client state exists; the error is best effort
+    connected_clients--;
+    send(fd, error, std::strlen(error), MSG_DONTWAIT | MSG_NOSIGNAL);
+    close(fd);
+    return false;
+}
+
+bool checkQueryBufferLimits(Client& c) {
+    if (c.querybuf.size() - c.querypos + c.parser.pendingBytes() > MAX_QUERYBUF_LEN) {
+        std::cerr << "Closing client " << c.addr << " that reached max query buffer length" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool readPaused(const Client& c) {
+    size_t limit = server_config.client_max_inflight;
+    if (limit == 0) return false;
+
+    // Replies at the limit, or requests at the limit queued behind a range
+    // reply. A partial command is never held back, since it must be read
+    // whole before anything can run.
+    return c.inflight_paused || (c.range_reply && c.querybuf.size() - c.querypos >= limit);
+}
+
+bool checkOutputBufferLimits(Client& c) {
+    size_t used = c.reply.size();
+    size_t hard = server_config.client_obuf_hard;
+    size_t soft = server_config.client_obuf_soft;
+
+    bool hard_exceeded = hard > 0 && used >= hard;
+    bool soft_exceeded = soft > 0 && used >= soft;
+
+    if (soft_exceeded) {
+        auto now = std::chrono::steady_clock::now();
+        if (!c.soft_limit_reached) {
+            c.soft_limit_reached = true;
+            c.soft_limit_since = now;
+        } else {
+            auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - c.soft_limit_since);
+            if (elapsed.count() >= server_config.client_obuf_soft_seconds) {
+                hard_exceeded = true;
+            }
+        }
+    } else {
+        c.soft_limit_reached = false;
+    }
+
+    if (hard_exceeded && !c.close_asap) {
+        std::cerr << "Client " << c.addr << " scheduled to be closed ASAP for overcoming of output buffer limits ("
+                  << used << " bytes pending)" << std::endl;
+        c.close_asap = true;
+    }
+    return !c.close_asap;
+}
+
+void addReply(Client& c, const RESPValue& reply) {
+    if (c.close_asap) return;
+    serializeRESP(reply, c.reply);
+    checkOutputBufferLimits(c);
+}
+
+// HELLO [protover]: switch protocol and describe the server
+static RESPValue handleHELLO(Client& c, const std::vector<RESPValue>& args) {
+    if (args.size() > 2) {
+        return RESPValue(RESPType::Error, "ERR Syntax error in HELLO option '" + args[2].str + "'");
+    }
+    if (args.size() == 2) {
+        if (args[1].str != "2" && args[1].str != "3") {
+            return RESPValue(RESPType::Error, "NOPROTO unsupported protocol version");
+        }
+        c.resp = args[1].str[0] - '0';
+    }
+
+    std::vector<RESPValue> info;
+    info.push_back(RESPValue(RESPType::BulkString, "server"));
+    info.push_back(RESPValue(RESPType::BulkString, "redis-streams"));
+    info.push_back(RESPValue(RESPType::BulkString, "version"));
+    info.push_back(RESPValue(RESPType::BulkString, "1.0.0"));
+    info.push_back(RESPValue(RESPType::BulkString, "proto"));
+    info.push_back(RESPValue(static_cast<int64_t>(c.resp)));
+    info.push_back(RESPValue(RESPType::BulkString, "id"));
+    info.push_back(RESPValue(static_cast<int64_t>(c.id)));
+    info.push_back(RESPValue(RESPType::BulkString, "mode"));
+    info.push_back(RESPValue(RESPType::BulkString, "standalone"));
+
+    // RESP2 clients get the same pairs as a flat array
+    RESPValue reply(std::move(info));
+    if (c.resp == 3) {
+        reply.type = RESPType::Map;
+    }
+    return reply;
+}
+
+// MULTI/EXEC/DISCARD and HELLO need per-client state, so they are handled
+// here; all other commands go to the stateless dispatcher, or are queued
+// inside MULTI
+static RESPValue processCommand(Client& c, const std::string& name, RESPValue& command) {
+    if (name == "HELLO") {
+        return handleHELLO(c, command.array);
+    }
+
+    if (name == "MULTI") {
+        if (c.in_multi) {
+            return RESPValue(RESPType::Error, "ERR MULTI calls can not be nested");
+        }
+        c.in_multi = true;
+        c.multi_dirty = false;
+        return RESPValue(RESPType::SimpleString, "OK");
+    }
+
+    if (name == "EXEC" || name == "DISCARD") {
+        if (!c.in_multi) {
+            return RESPValue(RESPType::Error, "ERR " + name + " without MULTI");
+        }
+        std::vector<RESPValue> queued;
+        queued.swap(c.multi_queue);
+        bool dirty = c.multi_dirty;
+        c.in_multi = false;
+        c.multi_dirty = false;
+
+        if (name == "DISCARD") {
+            return RESPValue(RESPType::SimpleString, "OK");
+        }
+        if (dirty) {
+            return RESPValue(RESPType::Error, "EXECABORT Transaction discarded because of previous errors.");
+        }
+        return execTransaction(queued);
+    }
+
+    if (c.in_multi) {
+        // Commands that can't run make the whole transaction fail at EXEC
+        if (name.empty()) {
+            c.multi_dirty = true;
+            return RESPValue(RESPType::Error, "ERR invalid command");
+        }
+        if (!commandExists(name)) {
+            c.multi_dirty = true;
+            return RESPValue(RESPType::Error, "ERR unknown command '" + command.array[0].str + "'");
+        }
+        c.multi_queue.push_back(std::move(command));
+        return RESPValue(RESPType::SimpleString, "QUEUED");
+    }
+
+    return handleCommand(command);
+}
+
+// XRANGE / XREVRANGE: write what fits in one chunk now; the rest follows as
+// the socket drains
+static void startRangeReply(Client& c, const std::vector<RESPValue>& args, bool reverse) {
+    RESPValue error;
+    std::unique_ptr<RangeReply> range = openRangeReply(args, reverse, error);
+    if (!range) {
+        addReply(c, error);
+        return;
+    }
+    if (!range->fill(c.reply, RANGE_REPLY_CHUNK)) {
+        c.range_reply = std::move(range);
+    } else if (range->truncated()) {
+        c.close_after_reply = true;  // See resumeClient
+    }
+    checkOutputBufferLimits(c);
+}
+
+static bool inflightExceeded(const Client& c) {
+    size_t limit = server_config.client_max_inflight;
+    return limit > 0 && c.reply.size() >= limit;
+}
+
+// client-command-rate: refill the client's bucket for the time since the
+// last command (holding up to one second's worth) and take a token
+static bool takeRateToken(Client& c, int rate) {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - c.rate_refilled).count();
+    c.rate_refilled = now;
+    c.rate_tokens = std::min(static_cast<double>(rate), c.rate_tokens + elapsed * rate);
+    if (c.rate_tokens < 1) return false;
+    c.rate_tokens -= 1;
+    return true;
+}
+
+// Refuse a command without running it; inside MULTI this also fails the
+// transaction, as any command that can't be queued does
+static void rejectCommand(Client& c, const std::string& error) {
+    if (c.in_multi) {
+        c.multi_dirty = true;
+    }
+    addReply(c, RESPValue(RESPType::Error, error));
+}
+
+void resumeClient(Client& c) {
+    if (c.close_asap) return;
+
+    if (c.range_reply) {
+        if (c.reply.size() >= RANGE_REPLY_CHUNK || !c.range_reply->fill(c.reply, RANGE_REPLY_CHUNK)) {
+            checkOutputBufferLimits(c);
+            return;
+        }
+        if (c.range_reply->truncated()) {
+            // The client can't parse past a short array, so end here
+            c.close_after_reply = true;
+        }
+        c.range_reply.reset();
+        pushPendingEntries(c);
+        processInputBuffer(c);
+    } else if (c.inflight_paused && !inflightExceeded(c)) {
+        c.inflight_paused = false;
+        processInputBuffer(c);
+    }
+    checkOutputBufferLimits(c);
+}
+
+void processInputBuffer(Client& c) {
+    while (!c.close_after_reply && !c.close_asap && !c.range_reply) {
+        // Let the client read what it has before producing more
+        if (inflightExceeded(c)) {
+            c.inflight_paused = true;
+            break;
+        }
+
+        RESPValue command;
+        try {
+            if (!c.parser.parse(c.querybuf, c.querypos, command)) break;
+        } catch (const std::exception& e) {
+            // The stream can't be resynchronized after a protocol error
+            addReply(c, RESPValue(RESPType::Error, "ERR " + std::string(e.what())));
+            c.close_after_reply = true;
+            break;
+        }
+
+        std::string name;
+        if (command.type == RESPType::Array && !command.array.empty()) {
+            name = command.array[0].str;
+            std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+            if (capture_enabled.load(std::memory_order_relaxed)) {
+                captureCommand(c.id, command.array);
+            }
+        }
+
+        if (name == "QUIT") {
+            addReply(c, handleQUIT(command.array));
+            c.close_after_reply = true;
+            break;
+        }
+
+        // Admission control. EXEC and DISCARD only finish what was admitted
+        // when the transaction's commands were queued.
+        if (name != "EXEC" && name != "DISCARD") {
+            int rate = server_config.client_command_rate;
+            if (rate > 0 && !takeRateToken(c, rate)) {
+                rejectCommand(c, "ERR max command rate per client exceeded");
+                continue;
+            }
+            if (c.load && c.load->overloaded() && commandIsWrite(name)) {
+                rejectCommand(c, "BUSY server is overloaded, write commands are refused, try again later");
+                continue;
+            }
+        }
+
+        // Subscription commands reply with one frame per key. They change
+        // the connection's state, so they can't be queued in a transaction.
+        if (name == "XSUBSCRIBE" || name == "XUNSUBSCRIBE") {
+            if (c.in_multi) {
+                rejectCommand(c, "ERR " + name + " is not allowed inside a transaction");
+            } else if (name == "XSUBSCRIBE") {
+                subscribeStreams(c, command.array);
+            } else {
+                unsubscribeStreams(c, command.array);
+            }
+            continue;
+        }
+
+        // RESP2 can't tell pushes from replies, so a subscribed RESP2 client
+        // may only manage its subscriptions
+        if (c.resp == 2 && !c.subscriptions.empty() && name != "PING" && name != "HELLO") {
+            addReply(c, RESPValue(RESPType::Error, "ERR Can't execute '" + command.array[0].str +
+                                  "': only XSUBSCRIBE / XUNSUBSCRIBE / PING / QUIT / HELLO are allowed in this context"));
+            continue;
+        }
+
+        // Range replies outside MULTI are streamed instead of built whole
+        if (!c.in_multi && (name == "XRANGE" || name == "XREVRANGE")) {
+            startRangeReply(c, command.array, name == "XREVRANGE");
+            continue;
+        }
+
+        addReply(c, processCommand(c, name, command));
+    }
+
+    // Drop executed commands, and arguments the parser has taken, in one go
+    if (c.querypos > 0) {
+        c.querybuf.erase(0, c.querypos);
+        c.querypos = 0;
+    }
+}
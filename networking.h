@@ -0,0 +1,137 @@
+#pragma once
+#include "buffer.h"
+#include "resp_parser.h"
+#include "stream.h"
+#include "range.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+class PushMailbox;
+
+// Unique id for each new client (never 0)
+uint64_t nextClientId();
+
+// How long commands wait in one event loop before they run. A loop handles
+// everything one wakeup reports as a batch, so a request that arrives
+// meanwhile waits until the batch ends; the last batch's duration, or the
+// current one's so far, estimates that wait. While it exceeds
+// shed-latency-ms the loop sheds load: it refuses new connections and write
+// commands but keeps serving reads and pushes to the clients it has.
+class LoadMonitor {
+public:
+    LoadMonitor() : last_batch_us(0), shedding(false) {}
+
+    // Bracket the handling of one wakeup's events
+    void batchStarted();
+    void batchFinished();
+
+    // Whether to shed load now
+    bool overloaded() const;
+
+private:
+    std::chrono::steady_clock::time_point batch_start;
+    int64_t last_batch_us;
+    bool shedding;  // As of the last batch, for logging changes
+};
+
+// Tailing position of an XSUBSCRIBE'd stream
+struct StreamSubscription {
+    std::weak_ptr<Stream> stream;  // Detects the key being created or replaced
+    uint64_t next_pos;  // Next stream position to push
+    StreamID next_id;  // Next ID to push from a partitioned stream, whose positions are per partition
+};
+
+// Per-connection state, owned by the event loop thread that accepted it
+struct Client {
+    uint64_t id;
+    int fd;
+    std::string addr;  // "ip:port", for logging
+    std::string querybuf;  // Bytes read but not yet executed
+    size_t querypos;  // Parse offset into querybuf
+    RESPParser parser;  // State of a command split across reads
+    OutputBuffer reply;  // Serialized replies waiting for the socket
+    bool want_write;  // Registered for writability with the event loop
+    bool read_paused;  // Not registered for reads: see readPaused()
+
+    // When the reply buffer first went over the soft limit
+    bool soft_limit_reached;
+    std::chrono::steady_clock::time_point soft_limit_since;
+
+    // XRANGE / XREVRANGE reply still being written. Commands behind it and
+    // pushes wait until it completes.
+    std::unique_ptr<RangeReply> range_reply;
+
+    bool close_after_reply;  // QUIT or protocol error: close once flushed
+    bool close_asap;  // Output limit exceeded: drop pending output and close
+
+    // Commands wait while unsent replies are over client-max-inflight
+    bool inflight_paused;
+
+    // client-command-rate token bucket
+    double rate_tokens;
+    std::chrono::steady_clock::time_point rate_refilled;
+
+    // MULTI state: commands queued until EXEC, and whether one was rejected
+    bool in_multi;
+    bool multi_dirty;
+    std::vector<RESPValue> multi_queue;
+
+    int resp;  // Protocol version chosen with HELLO (2 or 3)
+
+    // Streams this client tails, and the mailbox of the loop that owns it
+    std::map<std::string, StreamSubscription> subscriptions;
+    PushMailbox* mailbox;
+
+    LoadMonitor* load;  // The owning loop's
+
+    // Takes the maxclients slot reserved by admitClient()
+    Client(int sock, const std::string& address)
+        : id(nextClientId()), fd(sock), addr(address), querypos(0), want_write(false), read_paused(false),
+          soft_limit_reached(false), close_after_reply(false), close_asap(false), inflight_paused(false),
+          rate_tokens(0), in_multi(false), multi_dirty(false), resp(2), mailbox(nullptr), load(nullptr) {}
+    ~Client();
+};
+
+// Decide on a just-accepted connection: reserve one of maxclients slots, or
+// reply with an error and close it right away if the server is full or the
+// accepting loop is shedding load. Returns false if the socket was closed.
+bool admitClient(int fd, const LoadMonitor& load);
+
+// Largest chunk read from a socket per readiness event
+constexpr size_t READ_CHUNK = 16 * 1024;
+
+// Largest amount of unparsed input a client may accumulate
+constexpr size_t MAX_QUERYBUF_LEN = 1024 * 1024 * 1024;
+
+// Range replies are encoded into the output buffer about this much at a time
+constexpr size_t RANGE_REPLY_CHUNK = 64 * 1024;
+
+// Parse and execute every complete command in the client's query buffer,
+// queueing replies into its output buffer
+void processInputBuffer(Client& c);
+
+// Called once the socket has taken some output: top up the reply buffer
+// from a range reply in progress, and run commands held back by it or by
+// client-max-inflight once that no longer applies. Held-back pushes are
+// sent when the range reply completes.
+void resumeClient(Client& c);
+
+// Queue a reply, then enforce client-output-buffer-limit
+void addReply(Client& c, const RESPValue& reply);
+
+// Check unexecuted input against MAX_QUERYBUF_LEN. Returns false if the
+// client must be disconnected.
+bool checkQueryBufferLimits(Client& c);
+
+// Whether the event loop should stop reading from the client: its commands
+// can't run until it reads its replies (client-max-inflight), so further
+// requests are left to TCP flow control instead of the query buffer
+bool readPaused(const Client& c);
+
+// Check the reply buffer against the configured limits. Returns false (and
+// flags the client with close_asap) if it must be disconnected.
+bool checkOutputBufferLimits(Client& c);
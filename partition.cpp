@@ -0,0 +1,148 @@
+#include "partition.h"
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+PartitionedStream::PartitionedStream(size_t count, Policy policy, const std::string& hash_field)
+    : route(policy), field(hash_field), next_partition(0) {
+    for (size_t i = 0; i < count; ++i) {
+        partitions.emplace_back(new Partition());
+    }
+}
+
+size_t PartitionedStream::pickPartition(const FieldMap& fields) {
+    if (route == Policy::Hash) {
+        auto it = fields.find(field);
+        if (it != fields.end()) {
+            return std::hash<std::string>()(it->second.str()) % partitions.size();
+        }
+    }
+    return next_partition.fetch_add(1, std::memory_order_relaxed) % partitions.size();
+}
+
+StreamID PartitionedStream::reserveId(const std::string& requested) {
+    std::lock_guard<std::mutex> lock(id_mutex);
+
+    StreamID id;
+    if (requested == "*") {
+        uint64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        id = now > last_id.ms ? StreamID(now, 0) : StreamID(last_id.ms, last_id.seq + 1);
+    } else {
+        if (!StreamID::parse(requested, id)) {
+            throw std::runtime_error("Invalid stream ID specified as stream command argument");
+        }
+        if (!(last_id < id)) {
+            throw std::runtime_error("The ID specified in XADD is equal or smaller than the target stream top item");
+        }
+    }
+
+    last_id = id;
+    in_flight.insert(id);
+    return id;
+}
+
+void PartitionedStream::published(const StreamID& id) {
+    std::lock_guard<std::mutex> lock(id_mutex);
+    in_flight.erase(id);
+}
+
+StreamID PartitionedStream::visibleLimit() const {
+    std::lock_guard<std::mutex> lock(id_mutex);
+    if (!in_flight.empty()) {
+        return *in_flight.begin();
+    }
+    return StreamID(last_id.ms, last_id.seq + 1);
+}
+
+std::string PartitionedStream::addEntry(FieldMap fields, const std::string& id) {
+    if (fields.empty()) {
+        throw std::runtime_error("ERR wrong number of arguments for 'xadd' command");
+    }
+
+    Partition& part = *partitions[pickPartition(fields)];
+    std::lock_guard<std::mutex> lock(part.mutex);
+
+    StreamID entry_id = reserveId(id);
+    std::string entry_str = entry_id.toString();
+    part.stream.addAssignedEntry(entry_str, std::move(fields));
+    published(entry_id);
+    return entry_str;
+}
+
+RangeWalk PartitionedStream::walk(const StreamID& start, const StreamID& end, bool reverse) const {
+    // Stop below the oldest ID still being written; entries published later
+    // can't land under it, so the walk's range is fixed from here on
+    StreamID limit = visibleLimit();
+    StreamID last = end;
+    if (!(last < limit)) {
+        if (limit.seq > 0) {
+            last = StreamID(limit.ms, limit.seq - 1);
+        } else if (limit.ms > 0) {
+            last = StreamID(limit.ms - 1, UINT64_MAX);
+        } else {
+            return RangeWalk(std::vector<const Stream*>(), start, end, reverse);
+        }
+    }
+
+    std::vector<const Stream*> streams;
+    for (const auto& part : partitions) {
+        streams.push_back(&part->stream);
+    }
+    return RangeWalk(streams, start, last, reverse);
+}
+
+std::vector<std::shared_ptr<const EncodedRESP>> PartitionedStream::getRange(const StreamID& start,
+                                                                           const StreamID& end,
+                                                                           int count) const {
+    std::vector<std::shared_ptr<const EncodedRESP>> result;
+    RangeWalk merged = walk(start, end, false);
+    size_t max = count > 0 ? static_cast<size_t>(count) : std::numeric_limits<size_t>::max();
+    merged.next(max, [&](const StreamEntry& entry) {
+        result.push_back(entry.encoded());
+        return true;
+    });
+    return result;
+}
+
+size_t PartitionedStream::length() const {
+    size_t total = 0;
+    for (const auto& part : partitions) {
+        total += part->stream.length();
+    }
+    return total;
+}
+
+size_t PartitionedStream::memoryUsage() {
+    size_t total = 0;
+    for (auto& part : partitions) {
+        std::lock_guard<std::mutex> lock(part->mutex);
+        total += part->stream.memoryUsage();
+    }
+    return total;
+}
+
+uint64_t PartitionedStream::entriesAdded() {
+    uint64_t total = 0;
+    for (auto& part : partitions) {
+        std::lock_guard<std::mutex> lock(part->mutex);
+        total += part->stream.entriesAdded();
+    }
+    return total;
+}
+
+std::string PartitionedStream::lastGeneratedId() {
+    std::lock_guard<std::mutex> lock(id_mutex);
+    return last_id.toString();
+}
+
+size_t PartitionedStream::expireBefore(uint64_t min_ms, size_t max_entries) {
+    size_t removed = 0;
+    for (auto& part : partitions) {
+        if (removed == max_entries) break;
+        std::lock_guard<std::mutex> lock(part->mutex);
+        removed += part->stream.expireBefore(min_ms, max_entries - removed);
+    }
+    return removed;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "stream.h"
+#include "range.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// A logical stream spread over several Stream partitions so that appends
+// to different partitions can run in parallel.
+//
+// Each partition is written under its own mutex rather than the command
+// write lock. IDs come from one generator shared by all partitions, so they
+// are unique and totally ordered, and a merged read sees one stream. An ID
+// is reserved while holding the partition's mutex, which keeps every
+// partition in ID order; readers stop below the oldest ID still being
+// written, so a consumer resuming after the last ID it saw never skips an
+// entry another partition publishes late.
+class PartitionedStream {
+public:
+    enum class Policy { RoundRobin, Hash };
+
+    PartitionedStream(size_t count, Policy policy, const std::string& field);
+    PartitionedStream(const PartitionedStream&) = delete;
+    PartitionedStream& operator=(const PartitionedStream&) = delete;
+
+    size_t partitionCount() const { return partitions.size(); }
+    Policy policy() const { return route; }
+    const std::string& hashField() const { return field; }
+
+    // Append to the partition picked by the policy (round robin, or a hash
+    // of the field's value; entries without the field go round robin).
+    // Takes only that partition's mutex. id is "*", "ms" or "ms-seq" and
+    // must be above every ID in the stream. Throws on a bad ID.
+    std::string addEntry(FieldMap fields, const std::string& id);
+
+    // Entries with IDs in [start, end], merged across partitions in ID
+    // order, at most count of them (all if count <= 0). Lock-free.
+    std::vector<std::shared_ptr<const EncodedRESP>> getRange(const StreamID& start, const StreamID& end,
+                                                             int count) const;
+
+    // Merged walk over [start, end] for XRANGE / XREVRANGE, limited to the
+    // entries visible now (lock-free)
+    RangeWalk walk(const StreamID& start, const StreamID& end, bool reverse) const;
+
+    // Exclusive upper bound on IDs a reader may return: every entry below
+    // it has been published
+    StreamID visibleLimit() const;
+
+    // Live entries across partitions (lock-free)
+    size_t length() const;
+
+    // Totals across partitions; these take each partition's mutex
+    size_t memoryUsage();
+    uint64_t entriesAdded();
+    std::string lastGeneratedId();
+
+    // Expire up to max_entries entries older than min_ms, one partition
+    // after another. Same contract as Stream::expireBefore.
+    size_t expireBefore(uint64_t min_ms, size_t max_entries);
+
+    // Direct access for eviction; hold the partition's mutex while using it
+    Stream& partition(size_t i) { return partitions[i]->stream; }
+    std::mutex& partitionMutex(size_t i) { return partitions[i]->mutex; }
+
+private:
+    struct Partition {
+        std::mutex mutex;
+        Stream stream;
+    };
+
+    std::vector<std::unique_ptr<Partition>> partitions;
+    const Policy route;
+    const std::string field;
+    std::atomic<uint64_t> next_partition;  // Round-robin counter
+
+    mutable std::mutex id_mutex;
+    StreamID last_id;  // Guarded by id_mutex
+    std::set<StreamID> in_flight;  // Reserved IDs not yet published; guarded by id_mutex
+
+    size_t pickPartition(const FieldMap& fields);
+
+    // Assign the next ID (caller holds the target partition's mutex) and
+    // mark it in flight until published() is called
+    StreamID reserveId(const std::string& requested);
+    void published(const StreamID& id);
+};
@@ -0,0 +1,246 @@
+#include "pubsub.h"
+#include "networking.h"
+#include "commands.h"
+#include "partition.h"
+#include <atomic>
+#include <stdexcept>
+#include <cstdint>
+#include <limits>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Which loops have clients tailing each key, with a client count per loop
+static std::mutex watchers_mutex;
+static std::map<std::string, std::map<PushMailbox*, int>> watchers;
+static std::atomic<size_t> watched_keys(0);
+
+PushMailbox::PushMailbox() {
+    efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+        throw std::runtime_error("eventfd failed");
+    }
+}
+
+PushMailbox::~PushMailbox() {
+    close(efd);
+}
+
+void PushMailbox::post(const std::string& key) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake = pending.empty();
+        pending.insert(key);
+    }
+
+    // Only the first post since the last deliver() needs to ring
+    if (wake) {
+        uint64_t one = 1;
+        ssize_t n = write(efd, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+void PushMailbox::addSubscriber(const std::string& key, Client* c) {
+    subscribers[key].insert(c);
+}
+
+void PushMailbox::removeSubscriber(const std::string& key, Client* c) {
+    auto it = subscribers.find(key);
+    if (it == subscribers.end()) return;
+    it->second.erase(c);
+    if (it->second.empty()) {
+        subscribers.erase(it);
+    }
+}
+
+// Send a client everything appended to key since its last push, as one frame
+static bool pushNewEntries(Client& c, const std::string& key) {
+    auto it = c.subscriptions.find(key);
+    if (it == c.subscriptions.end()) return false;
+    StreamSubscription& sub = it->second;
+
+    // A push can't go in the middle of a range reply; it is sent once the
+    // reply completes
+    if (c.range_reply) return false;
+
+    std::shared_ptr<Stream> stream = lookupStream(key);
+    if (!stream) return false;
+    if (sub.stream.lock() != stream) {
+        // The key was created (or replaced) after subscribing: start over
+        sub.stream = stream;
+        sub.next_pos = 0;
+        sub.next_id = StreamID();
+    }
+
+    std::vector<RESPValue> entries;
+    if (PartitionedStream* parts = stream->partitions()) {
+        // The merged walk stops below IDs still being written, so an entry
+        // published late by another partition is pushed once it is visible
+        RangeWalk merged = parts->walk(sub.next_id, StreamID(UINT64_MAX, UINT64_MAX), false);
+        merged.next(std::numeric_limits<size_t>::max(), [&](const StreamEntry& entry) {
+            entries.push_back(RESPValue(entry.encoded()));
+            StreamID pushed;
+            StreamID::parse(entry.id, pushed);
+            sub.next_id = StreamID(pushed.ms, pushed.seq + 1);
+            return true;
+        });
+    } else {
+        stream->forEachEntryFrom(sub.next_pos, [&](uint64_t pos, const StreamEntry& entry) {
+            entries.push_back(RESPValue(entry.encoded()));
+            sub.next_pos = pos + 1;
+            return true;
+        });
+    }
+    if (entries.empty()) return false;
+
+    std::vector<RESPValue> frame;
+    frame.push_back(RESPValue(RESPType::BulkString, "xmessage"));
+    frame.push_back(RESPValue(RESPType::BulkString, key));
+    frame.push_back(RESPValue(std::move(entries)));
+    addReply(c, pushFrame(c, std::move(frame)));
+    return true;
+}
+
+void pushPendingEntries(Client& c) {
+    for (const auto& sub : c.subscriptions) {
+        pushNewEntries(c, sub.first);
+    }
+}
+
+std::vector<Client*> PushMailbox::deliver() {
+    uint64_t count;
+    ssize_t n = read(efd, &count, sizeof(count));
+    (void)n;
+
+    std::set<std::string> keys;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        keys.swap(pending);
+    }
+
+    std::set<Client*> touched;
+    for (const auto& key : keys) {
+        auto it = subscribers.find(key);
+        if (it == subscribers.end()) continue;
+        for (Client* c : it->second) {
+            if (pushNewEntries(*c, key)) {
+                touched.insert(c);
+            }
+        }
+    }
+    return std::vector<Client*>(touched.begin(), touched.end());
+}
+
+static void watch(const std::string& key, PushMailbox* mailbox) {
+    std::lock_guard<std::mutex> lock(watchers_mutex);
+    watchers[key][mailbox]++;
+    watched_keys.store(watchers.size());
+}
+
+static void unwatch(const std::string& key, PushMailbox* mailbox) {
+    std::lock_guard<std::mutex> lock(watchers_mutex);
+    auto it = watchers.find(key);
+    if (it == watchers.end()) return;
+    if (--it->second[mailbox] == 0) {
+        it->second.erase(mailbox);
+        if (it->second.empty()) {
+            watchers.erase(it);
+        }
+    }
+    watched_keys.store(watchers.size());
+}
+
+static void unsubscribeKey(Client& c, const std::string& key) {
+    auto it = c.subscriptions.find(key);
+    if (it == c.subscriptions.end()) return;
+
+    // key may refer to the map node itself, so erase it last
+    c.mailbox->removeSubscriber(key, &c);
+    unwatch(key, c.mailbox);
+    c.subscriptions.erase(it);
+}
+
+static RESPValue subscriptionFrame(const Client& c, const char* kind, const RESPValue& key) {
+    std::vector<RESPValue> frame;
+    frame.push_back(RESPValue(RESPType::BulkString, kind));
+    frame.push_back(key);
+    frame.push_back(RESPValue(static_cast<int64_t>(c.subscriptions.size())));
+    return pushFrame(c, std::move(frame));
+}
+
+void subscribeStreams(Client& c, const std::vector<RESPValue>& args) {
+    if (args.size() < 2) {
+        addReply(c, RESPValue(RESPType::Error, "ERR wrong number of arguments for 'xsubscribe' command"));
+        return;
+    }
+
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& key = args[i].str;
+        if (c.subscriptions.find(key) == c.subscriptions.end()) {
+            // Register before reading the end position: an XADD racing with
+            // us is then either below that position or notifies us
+            watch(key, c.mailbox);
+            c.mailbox->addSubscriber(key, &c);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            std::shared_ptr<Stream> stream = lookupStream(key);
+            StreamSubscription& sub = c.subscriptions[key];
+            sub.stream = stream;
+            sub.next_pos = stream ? stream->endPosition() : 0;
+            PartitionedStream* parts = stream ? stream->partitions() : nullptr;
+            sub.next_id = parts ? parts->visibleLimit() : StreamID();
+        }
+        addReply(c, subscriptionFrame(c, "xsubscribe", args[i]));
+    }
+}
+
+void unsubscribeStreams(Client& c, const std::vector<RESPValue>& args) {
+    std::vector<std::string> keys;
+    if (args.size() > 1) {
+        for (size_t i = 1; i < args.size(); ++i) {
+            keys.push_back(args[i].str);
+        }
+    } else {
+        for (const auto& sub : c.subscriptions) {
+            keys.push_back(sub.first);
+        }
+        if (keys.empty()) {
+            addReply(c, subscriptionFrame(c, "xunsubscribe", RESPValue()));
+            return;
+        }
+    }
+
+    for (const auto& key : keys) {
+        unsubscribeKey(c, key);
+        addReply(c, subscriptionFrame(c, "xunsubscribe", RESPValue(RESPType::BulkString, key)));
+    }
+}
+
+void unsubscribeAll(Client& c) {
+    while (!c.subscriptions.empty()) {
+        unsubscribeKey(c, c.subscriptions.begin()->first);
+    }
+}
+
+void notifyStreamSubscribers(const std::string& key) {
+    // Most writes go to keys nobody tails; skip the lock for them. The fence
+    // pairs with the one in subscribeStreams.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (watched_keys.load(std::memory_order_relaxed) == 0) return;
+
+    std::lock_guard<std::mutex> lock(watchers_mutex);
+    auto it = watchers.find(key);
+    if (it == watchers.end()) return;
+    for (const auto& watcher : it->second) {
+        watcher.first->post(key);
+    }
+}
+
+RESPValue pushFrame(const Client& c, std::vector<RESPValue> items) {
+    RESPValue frame(std::move(items));
+    if (c.resp == 3) {
+        frame.type = RESPType::Push;
+    }
+    return frame;
+}
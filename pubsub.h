@@ -0,0 +1,60 @@
+#pragma once
+#include "resp_parser.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+
+struct Client;
+
+// Wakes one event loop when streams its clients tail get new entries.
+// Writers on any thread post the key; the owning loop is woken through an
+// eventfd and pushes the new entries to its subscribers. Posts for a key
+// that is already pending are merged, so a burst of XADDs costs each
+// subscriber a single wakeup and a single push frame.
+class PushMailbox {
+public:
+    PushMailbox();
+    ~PushMailbox();
+    PushMailbox(const PushMailbox&) = delete;
+    PushMailbox& operator=(const PushMailbox&) = delete;
+
+    // Readable when deliver() has work to do
+    int fd() const { return efd; }
+
+    // Flag key as having new entries (any thread)
+    void post(const std::string& key);
+
+    // Track which of this loop's clients tail a key (loop thread only)
+    void addSubscriber(const std::string& key, Client* c);
+    void removeSubscriber(const std::string& key, Client* c);
+
+    // Push pending entries to subscribed clients (loop thread only).
+    // Returns the clients that got output to flush.
+    std::vector<Client*> deliver();
+
+private:
+    int efd;
+    std::mutex mutex;
+    std::set<std::string> pending;  // Guarded by mutex
+    std::map<std::string, std::set<Client*>> subscribers;
+};
+
+// XSUBSCRIBE key [key ...]: tail the streams from their current end
+void subscribeStreams(Client& c, const std::vector<RESPValue>& args);
+
+// XUNSUBSCRIBE [key ...]: stop tailing the given keys (or all of them)
+void unsubscribeStreams(Client& c, const std::vector<RESPValue>& args);
+
+// Push whatever was held back while a range reply was being written
+void pushPendingEntries(Client& c);
+
+// Drop every subscription of a client that is going away
+void unsubscribeAll(Client& c);
+
+// Wake the loops of clients tailing key; called after appending to it
+void notifyStreamSubscribers(const std::string& key);
+
+// A push frame in the client's protocol: RESP3 push, or a plain array
+RESPValue pushFrame(const Client& c, std::vector<RESPValue> items);
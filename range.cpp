@@ -0,0 +1,114 @@
+#include "range.h"
+#include "buffer.h"
+#include <algorithm>
+#include <limits>
+
+// Replies of up to this many entries cache each entry's encoding, as every
+// other read does; longer ones are scans and encode on the fly
+constexpr size_t RANGE_CACHE_MAX = 1024;
+
+// Entries walked per step while filling. Bounds the candidates a merge over
+// many partitions collects at once.
+constexpr size_t RANGE_BATCH = 256;
+
+RangeWalk::RangeWalk(std::vector<const Stream*> streams, const StreamID& range_start, const StreamID& range_end,
+                     bool rev)
+    : start(range_start), end(range_end), reverse(rev), finished(range_end < range_start) {
+    for (const Stream* stream : streams) {
+        Source src;
+        src.stream = stream;
+        src.mark.pos = reverse ? std::numeric_limits<uint64_t>::max() : 0;
+        src.exhausted = false;
+        src.pinned = false;
+        sources.push_back(src);
+    }
+    if (sources.empty()) {
+        finished = true;
+    }
+}
+
+bool RangeWalk::peek(size_t source, Head& head) {
+    Source& src = sources[source];
+    StreamBookmark mark = src.mark;
+    bool found = false;
+    bool exhausted = scan(src, mark, [&](const StreamID& id, const StreamEntry& entry,
+                                         const StreamBookmark& at) {
+        head.id = id;
+        head.source = source;
+        head.entry = &entry;
+        head.at = at;
+        found = true;
+        return false;
+    });
+    if (!found) {
+        src.exhausted = exhausted;
+        return false;
+    }
+    head.after = mark;
+    return true;
+}
+
+void RangeWalk::pin() {
+    for (Source& src : sources) {
+        src.snap = src.stream->pin();
+        src.pinned = true;
+    }
+}
+
+void RangeWalk::unpin() {
+    for (Source& src : sources) {
+        if (src.pinned) {
+            src.stream->unpin();
+            src.pinned = false;
+        }
+    }
+}
+
+size_t RangeWalk::count() const {
+    if (finished) return 0;
+
+    // IDs are unique across partitions, so their counts add up
+    size_t total = 0;
+    for (const Source& src : sources) {
+        total += src.stream->countRange(start, end, src.snap);
+    }
+    return total;
+}
+
+RangeReply::RangeReply(std::shared_ptr<Stream> s, const RangeWalk& range, size_t count)
+    : stream(std::move(s)), walk(range), sent(0), header_sent(false) {
+    walk.pin();
+    total = std::min(count, walk.count());
+    cache = total <= RANGE_CACHE_MAX;
+}
+
+RangeReply::~RangeReply() {
+    walk.unpin();
+}
+
+bool RangeReply::fill(OutputBuffer& out, size_t budget) {
+    if (!header_sent) {
+        std::string header = "*" + std::to_string(total) + "\r\n";
+        out.append(header);
+        header_sent = true;
+    }
+
+    // The snapshot holds exactly total entries as long as IDs grow with
+    // position, which appends enforce; should the walk still run out
+    // first, the reply ends there rather than waiting for entries that
+    // will never come
+    while (sent < total && out.size() < budget && !walk.done()) {
+        walk.next(std::min(total - sent, RANGE_BATCH), [&](const StreamEntry& entry) {
+            if (cache) {
+                for (const auto& segment : entry.encoded()->segments) {
+                    out.append(segment);
+                }
+            } else {
+                entry.appendEncoded(out);
+            }
+            ++sent;
+            return out.size() < budget;
+        });
+    }
+    return sent == total || walk.done();
+}
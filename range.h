@@ -0,0 +1,188 @@
+#pragma once
+#include "stream.h"
+#include "epoch.h"
+#include <vector>
+#include <memory>
+#include <queue>
+#include <cstdint>
+#include <cstddef>
+
+class OutputBuffer;
+
+// Walk over the entries with IDs in [start, end] of one or more streams
+// (the partitions of a partitioned stream), merged in ID order or, for
+// XREVRANGE, newest first. It can stop after any number of entries and pick
+// up later where it left off, in O(1), even if the streams changed in
+// between. The caller keeps the streams alive.
+class RangeWalk {
+public:
+    RangeWalk(std::vector<const Stream*> streams, const StreamID& start, const StreamID& end, bool reverse);
+
+    // Visit up to max more entries as fn(entry), which returns false to stop
+    // after the entry it was given. Returns the number visited.
+    template <typename Fn>
+    size_t next(size_t max, Fn fn);
+
+    // No entries left in range
+    bool done() const { return finished; }
+
+    // Read every stream as it is now until unpin(), however long the walk
+    // pauses: entries trimmed or deleted meanwhile are still returned, and
+    // ones added are not
+    void pin();
+    void unpin();
+
+    // Entries in range, for a pinned walk that hasn't started yet
+    size_t count() const;
+
+private:
+    struct Source {
+        const Stream* stream;
+        StreamBookmark mark;
+        bool exhausted;
+        bool pinned;
+        StreamSnapshot snap;  // Set while pinned
+    };
+
+    // Next entry of one source while merging several
+    struct Head {
+        StreamID id;
+        size_t source;
+        const StreamEntry* entry;
+        StreamBookmark at;  // Resumes the source at this entry
+        StreamBookmark after;  // Resumes it past this entry
+    };
+
+    // Orders the merge heap so its top is the next entry to return
+    struct HeadOrder {
+        bool reverse;
+        bool operator()(const Head& a, const Head& b) const { return reverse ? a.id < b.id : b.id < a.id; }
+    };
+
+    std::vector<Source> sources;
+    StreamID start;
+    StreamID end;
+    bool reverse;
+    bool finished;
+
+    // Visit in-range entries of one stream from mark as fn(id, entry, mark
+    // positioned at the entry) until fn returns false. Returns true if the
+    // stream ran out of entries in range instead.
+    template <typename Fn>
+    bool scan(const Source& src, StreamBookmark& mark, Fn fn) const;
+
+    // Next in-range entry of a source, without consuming it. Returns false
+    // (and marks the source exhausted) if there is none.
+    bool peek(size_t source, Head& head);
+};
+
+// One XRANGE / XREVRANGE reply produced a piece at a time, so a range over
+// millions of entries never sits in memory in full. The walk is pinned for
+// the reply's life: the array header counts the entries of that snapshot
+// chunk by chunk, and fill() then encodes exactly those as the client's
+// socket drains, whatever XDEL or trimming does in between.
+class RangeReply {
+public:
+    // stream may be null (missing key: an empty reply)
+    RangeReply(std::shared_ptr<Stream> stream, const RangeWalk& walk, size_t count);
+    ~RangeReply();
+    RangeReply(const RangeReply&) = delete;
+    RangeReply& operator=(const RangeReply&) = delete;
+
+    // Append the rest of the reply to out until it holds at least budget
+    // bytes. Returns true once the whole reply has been written, or once
+    // the walk ran out before the count announced (see truncated()).
+    bool fill(OutputBuffer& out, size_t budget);
+
+    // Fewer entries were sent than the header announced
+    bool truncated() const { return sent < total; }
+
+private:
+    std::shared_ptr<Stream> stream;  // Keeps the entries alive, even past DEL
+    RangeWalk walk;
+    size_t total;  // Entries announced in the header
+    size_t sent;  // Entries written so far
+    bool header_sent;
+    bool cache;  // Small replies fill the per-entry encoding cache as usual
+};
+
+template <typename Fn>
+bool RangeWalk::scan(const Source& src, StreamBookmark& mark, Fn fn) const {
+    bool stopped = false;
+    auto visit = [&](uint64_t pos, const StreamEntry& entry) {
+        StreamID id;
+        if (!StreamID::parse(entry.id, id)) return true;
+        if (reverse ? end < id : id < start) return true;  // Not in range yet
+        if (reverse ? id < start : end < id) return false;  // Past the range
+
+        // Position at the entry itself, so a merge can leave it unconsumed
+        StreamBookmark at = mark;
+        at.pos = reverse ? pos + 1 : pos;
+        if (!fn(id, entry, at)) {
+            stopped = true;
+            return false;
+        }
+        return true;
+    };
+
+    const StreamSnapshot* snap = src.pinned ? &src.snap : nullptr;
+    if (reverse) {
+        src.stream->forEachEntryBefore(mark, visit, snap);
+    } else {
+        src.stream->forEachEntryFrom(mark, visit, snap);
+    }
+    return !stopped;
+}
+
+template <typename Fn>
+size_t RangeWalk::next(size_t max, Fn fn) {
+    if (finished || max == 0) return 0;
+    size_t visited = 0;
+
+    if (sources.size() == 1) {
+        Source& src = sources[0];
+        src.exhausted = scan(src, src.mark, [&](const StreamID&, const StreamEntry& entry,
+                                                const StreamBookmark&) {
+            ++visited;
+            return fn(entry) && visited < max;
+        });
+        finished = src.exhausted;
+        return visited;
+    }
+
+    // Heads point into the chunks, so hold one epoch across the merge
+    EpochGuard guard;
+
+    std::priority_queue<Head, std::vector<Head>, HeadOrder> heap(HeadOrder{reverse});
+    for (size_t s = 0; s < sources.size(); ++s) {
+        Head head;
+        if (!sources[s].exhausted && peek(s, head)) {
+            heap.push(head);
+        }
+    }
+
+    bool more = true;
+    while (more && !heap.empty() && visited < max) {
+        Head head = heap.top();
+        heap.pop();
+        sources[head.source].mark = head.after;
+        ++visited;
+        more = fn(*head.entry);
+
+        if (peek(head.source, head)) {
+            heap.push(head);
+        }
+    }
+
+    // Sources whose head wasn't consumed resume at it, past anything skipped
+    while (!heap.empty()) {
+        sources[heap.top().source].mark = heap.top().at;
+        heap.pop();
+    }
+
+    finished = true;
+    for (const Source& src : sources) {
+        finished = finished && src.exhausted;
+    }
+    return visited;
+}
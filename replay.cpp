@@ -0,0 +1,541 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Replays a traffic capture (see capture.h; CONFIG SET capture-file) against
+// a server and reports throughput and latency. Each captured connection gets
+// its own connection, and its commands are sent in their original order;
+// worker threads share out the connections and pace commands by their
+// captured timestamps, scaled by --speed, or send them back to back.
+
+using Clock = std::chrono::steady_clock;
+
+static const char CAPTURE_MAGIC[] = "RSCAP01\n";
+static const size_t CAPTURE_MAGIC_LEN = 8;
+
+struct Record {
+    uint64_t time_us;  // Since the start of the capture
+    uint64_t client;
+    bool disconnect;
+    bool skip;  // Not replayable; see loadCapture
+    std::string name;  // Upper-cased command name
+    std::string wire;  // The command as a RESP array
+};
+
+struct Options {
+    std::string capture;
+    std::string host = "127.0.0.1";
+    int port = 6380;
+    double speed = 1.0;  // 0 means as fast as possible
+    int workers = 16;
+    int pipeline = 1;
+    std::string report;
+    std::string baseline;
+};
+
+static bool getVarint(const std::string& data, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= data.size()) return false;
+        uint8_t byte = static_cast<uint8_t>(data[pos++]);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static bool loadCapture(const std::string& path, std::vector<Record>& records, std::string& err) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        err = "can't open " + path;
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.compare(0, CAPTURE_MAGIC_LEN, CAPTURE_MAGIC) != 0) {
+        err = path + " is not a capture file";
+        return false;
+    }
+
+    size_t pos = CAPTURE_MAGIC_LEN;
+    uint64_t now = 0;
+    while (pos < data.size()) {
+        uint64_t delta, client, argc;
+        if (!getVarint(data, pos, delta) || !getVarint(data, pos, client) || !getVarint(data, pos, argc)) {
+            // A capture cut short (server killed mid-write) keeps what came before
+            std::cerr << "Warning: truncated record at offset " << pos << ", ignoring the rest" << std::endl;
+            break;
+        }
+        now += delta;
+
+        Record rec;
+        rec.time_us = now;
+        rec.client = client;
+        rec.disconnect = argc == 0;
+        rec.skip = false;
+
+        std::vector<std::string> args;
+        bool complete = true;
+        for (uint64_t i = 0; i < argc; ++i) {
+            uint64_t len;
+            if (!getVarint(data, pos, len) || len > data.size() - pos) {
+                complete = false;
+                break;
+            }
+            args.push_back(data.substr(pos, len));
+            pos += len;
+        }
+        if (!complete) {
+            std::cerr << "Warning: truncated record at offset " << pos << ", ignoring the rest" << std::endl;
+            break;
+        }
+
+        if (!args.empty()) {
+            rec.name = args[0];
+            std::transform(rec.name.begin(), rec.name.end(), rec.name.begin(), ::toupper);
+            rec.wire = "*" + std::to_string(args.size()) + "\r\n";
+            for (const auto& arg : args) {
+                rec.wire += "$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+            }
+
+            std::string sub = args.size() > 2 ? args[1] + " " + args[2] : "";
+            std::transform(sub.begin(), sub.end(), sub.begin(), ::tolower);
+            if (rec.name == "QUIT") {
+                // The connection ends here either way
+                rec.disconnect = true;
+            } else if (rec.name == "XSUBSCRIBE" || rec.name == "XUNSUBSCRIBE" ||
+                       (rec.name == "CONFIG" && sub == "set capture-file")) {
+                // Subscriptions reply out of band, and replaying a capture
+                // must not switch off a capture of the replay itself
+                rec.skip = true;
+            }
+        }
+        records.push_back(std::move(rec));
+    }
+    return true;
+}
+
+// One replayed connection. Reads replies with an incremental RESP scanner,
+// so a huge reply (a long XRANGE) is never re-parsed or held in full.
+class Connection {
+public:
+    explicit Connection(int socket_fd) : fd(socket_fd), pos(0) {}
+    ~Connection() { close(fd); }
+
+    bool send(const std::string& data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = write(fd, data.data() + done, data.size() - done);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Read the next reply, skipping RESP3 push frames. Returns false if the
+    // connection failed; error is set for an error reply.
+    bool readReply(bool& error) {
+        while (true) {
+            char top;
+            if (!readValue(top)) return false;
+            if (top != '>') {
+                error = top == '-' || top == '!';
+                return true;
+            }
+        }
+    }
+
+private:
+    int fd;
+    std::string buf;
+    size_t pos;  // Scanned up to here
+
+    bool fill() {
+        char chunk[64 * 1024];
+        while (true) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n > 0) {
+                buf.append(chunk, n);
+                return true;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+    }
+
+    // Consume one complete value; top gets its type byte
+    bool readValue(char& top) {
+        std::vector<int64_t> pending;  // Elements left in each open aggregate
+        bool first = true;
+        while (true) {
+            size_t eol = buf.find("\r\n", pos);
+            if (eol == std::string::npos) {
+                if (!fill()) return false;
+                continue;
+            }
+
+            char type = buf[pos];
+            int64_t n = std::strtoll(buf.c_str() + pos + 1, nullptr, 10);
+            size_t next = eol + 2;
+            if ((type == '$' || type == '=' || type == '!') && n >= 0) {
+                next += static_cast<size_t>(n) + 2;
+                if (next > buf.size()) {
+                    if (!fill()) return false;
+                    continue;
+                }
+            }
+
+            if (first) {
+                top = type;
+                first = false;
+            }
+            pos = next;
+            if (pos > 1024 * 1024) {
+                buf.erase(0, pos);
+                pos = 0;
+            }
+
+            bool aggregate = type == '*' || type == '~' || type == '>' || type == '%';
+            if (aggregate && n > 0) {
+                pending.push_back(type == '%' ? n * 2 : n);
+                continue;
+            }
+
+            // A leaf (or empty aggregate) completes its parents' counts
+            while (!pending.empty() && --pending.back() == 0) {
+                pending.pop_back();
+            }
+            if (pending.empty()) {
+                buf.erase(0, pos);
+                pos = 0;
+                return true;
+            }
+        }
+    }
+};
+
+struct Stats {
+    uint64_t commands = 0;
+    uint64_t errors = 0;
+    uint64_t skipped = 0;
+    uint64_t late = 0;  // Sent behind schedule
+    bool failed = false;
+    std::vector<uint64_t> latencies;  // ns
+    std::map<std::string, std::vector<uint64_t>> by_command;
+};
+
+static Connection* openConnection(const Options& opts) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return nullptr;
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opts.port);
+    addr.sin_addr.s_addr = inet_addr(opts.host.c_str());
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return new Connection(fd);
+}
+
+// Replay one worker's share of the records, in capture order
+static void runWorker(const Options& opts, const std::vector<const Record*>& records, Clock::time_point start,
+                      Stats& stats) {
+    std::map<uint64_t, std::unique_ptr<Connection>> conns;
+
+    auto due = [&](const Record* rec) {
+        return start + std::chrono::microseconds(static_cast<uint64_t>(rec->time_us / opts.speed));
+    };
+
+    size_t i = 0;
+    while (i < records.size()) {
+        const Record* rec = records[i];
+        if (rec->disconnect) {
+            conns.erase(rec->client);
+            ++i;
+            continue;
+        }
+        if (rec->skip) {
+            stats.skipped++;
+            ++i;
+            continue;
+        }
+
+        if (opts.speed > 0) {
+            Clock::time_point when = due(rec);
+            if (Clock::now() < when) {
+                std::this_thread::sleep_until(when);
+            } else if (Clock::now() - when > std::chrono::milliseconds(1)) {
+                stats.late++;
+            }
+        }
+
+        std::unique_ptr<Connection>& conn = conns[rec->client];
+        if (!conn) {
+            conn.reset(openConnection(opts));
+            if (!conn) {
+                std::cerr << "Failed to connect to " << opts.host << ":" << opts.port << std::endl;
+                stats.failed = true;
+                return;
+            }
+        }
+
+        // Pipeline the next commands of the same connection that are already due
+        std::string batch = rec->wire;
+        size_t end = i + 1;
+        while (end < records.size() && end - i < static_cast<size_t>(opts.pipeline)) {
+            const Record* more = records[end];
+            if (more->client != rec->client || more->disconnect || more->skip) break;
+            if (opts.speed > 0 && due(more) > Clock::now()) break;
+            batch += more->wire;
+            ++end;
+        }
+
+        Clock::time_point sent = Clock::now();
+        if (!conn->send(batch)) {
+            std::cerr << "Connection lost while sending " << rec->name << std::endl;
+            stats.failed = true;
+            return;
+        }
+        for (size_t j = i; j < end; ++j) {
+            bool error = false;
+            if (!conn->readReply(error)) {
+                std::cerr << "Connection lost while waiting for a reply to " << records[j]->name << std::endl;
+                stats.failed = true;
+                return;
+            }
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sent).count();
+            stats.commands++;
+            stats.errors += error ? 1 : 0;
+            stats.latencies.push_back(ns);
+            stats.by_command[records[j]->name].push_back(ns);
+        }
+        i = end;
+    }
+}
+
+static double percentileUs(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[idx] / 1000.0;
+}
+
+// Report metrics, in the order they are printed and saved
+typedef std::vector<std::pair<std::string, double>> Metrics;
+
+static Metrics summarize(Stats& total, double seconds) {
+    std::sort(total.latencies.begin(), total.latencies.end());
+    double sum = 0;
+    for (uint64_t ns : total.latencies) sum += ns;
+
+    Metrics m;
+    m.push_back({"commands", static_cast<double>(total.commands)});
+    m.push_back({"errors", static_cast<double>(total.errors)});
+    m.push_back({"seconds", seconds});
+    m.push_back({"ops_per_sec", seconds > 0 ? total.commands / seconds : 0});
+    m.push_back({"latency_avg_us", total.latencies.empty() ? 0 : sum / total.latencies.size() / 1000.0});
+    m.push_back({"latency_p50_us", percentileUs(total.latencies, 0.50)});
+    m.push_back({"latency_p90_us", percentileUs(total.latencies, 0.90)});
+    m.push_back({"latency_p99_us", percentileUs(total.latencies, 0.99)});
+    m.push_back({"latency_p999_us", percentileUs(total.latencies, 0.999)});
+    m.push_back({"latency_max_us", total.latencies.empty() ? 0 : total.latencies.back() / 1000.0});
+    for (auto& entry : total.by_command) {
+        std::sort(entry.second.begin(), entry.second.end());
+        m.push_back({entry.first + ".count", static_cast<double>(entry.second.size())});
+        m.push_back({entry.first + ".p50_us", percentileUs(entry.second, 0.50)});
+        m.push_back({entry.first + ".p99_us", percentileUs(entry.second, 0.99)});
+    }
+    return m;
+}
+
+static bool loadReport(const std::string& path, std::map<std::string, double>& report) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string key;
+    double value;
+    while (in >> key >> value) {
+        report[key] = value;
+    }
+    return true;
+}
+
+static void printUsage() {
+    std::cerr << "Usage: ./replay <capture-file> [--host H] [--port P] [--speed N|max] [--workers N]\n"
+              << "                [--pipeline N] [--report FILE] [--baseline FILE]\n"
+              << "  --speed N       Replay at N times the captured pace (default 1), or max for no pacing\n"
+              << "  --workers N     Threads sharing out the captured connections (default 16)\n"
+              << "  --pipeline N    Send up to N due commands of a connection before reading replies (default 1)\n"
+              << "  --report FILE   Save the results, for use as a later --baseline\n"
+              << "  --baseline FILE Compare the results against a saved report" << std::endl;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& opts) {
+    if (argc < 2) return false;
+    opts.capture = argv[1];
+    for (int i = 2; i < argc; i += 2) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[i + 1];
+        try {
+            if (flag == "--host") {
+                opts.host = value;
+            } else if (flag == "--port") {
+                opts.port = std::stoi(value);
+            } else if (flag == "--speed") {
+                opts.speed = value == "max" ? 0 : std::stod(value);
+                if (opts.speed < 0) return false;
+            } else if (flag == "--workers") {
+                opts.workers = std::stoi(value);
+                if (opts.workers < 1) return false;
+            } else if (flag == "--pipeline") {
+                opts.pipeline = std::stoi(value);
+                if (opts.pipeline < 1) return false;
+            } else if (flag == "--report") {
+                opts.report = value;
+            } else if (flag == "--baseline") {
+                opts.baseline = value;
+            } else {
+                return false;
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<Record> records;
+    std::string err;
+    if (!loadCapture(opts.capture, records, err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+
+    // Deal the captured connections out to the workers in order of appearance
+    std::map<uint64_t, size_t> owner;
+    std::vector<std::vector<const Record*>> shares(opts.workers);
+    for (const Record& rec : records) {
+        auto it = owner.find(rec.client);
+        if (it == owner.end()) {
+            it = owner.emplace(rec.client, owner.size() % opts.workers).first;
+        }
+        shares[it->second].push_back(&rec);
+    }
+
+    std::cout << "Replaying " << records.size() << " records from " << owner.size() << " connections (";
+    if (opts.speed > 0) {
+        std::cout << opts.speed << "x speed)" << std::endl;
+    } else {
+        std::cout << "max speed)" << std::endl;
+    }
+
+    std::vector<Stats> stats(opts.workers);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    for (int w = 0; w < opts.workers; ++w) {
+        threads.emplace_back(runWorker, std::cref(opts), std::cref(shares[w]), start, std::ref(stats[w]));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    Stats total;
+    for (Stats& s : stats) {
+        total.commands += s.commands;
+        total.errors += s.errors;
+        total.skipped += s.skipped;
+        total.late += s.late;
+        total.failed = total.failed || s.failed;
+        total.latencies.insert(total.latencies.end(), s.latencies.begin(), s.latencies.end());
+        for (auto& entry : s.by_command) {
+            auto& into = total.by_command[entry.first];
+            into.insert(into.end(), entry.second.begin(), entry.second.end());
+        }
+    }
+    Metrics metrics = summarize(total, seconds);
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Replayed " << total.commands << " commands in " << std::setprecision(3) << seconds << " s ("
+              << std::setprecision(1) << metrics[3].second << " ops/sec)" << std::endl;
+    std::cout << "Errors: " << total.errors << ", skipped: " << total.skipped
+              << ", sent late: " << total.late << std::endl;
+    std::cout << "Latency (us): avg " << metrics[4].second << "  p50 " << metrics[5].second
+              << "  p90 " << metrics[6].second << "  p99 " << metrics[7].second
+              << "  p99.9 " << metrics[8].second << "  max " << metrics[9].second << std::endl;
+
+    std::cout << "\n" << std::left << std::setw(16) << "Command" << std::right << std::setw(10) << "Count"
+              << std::setw(12) << "p50 (us)" << std::setw(12) << "p99 (us)" << std::endl;
+    for (const auto& entry : total.by_command) {
+        const std::vector<uint64_t>& lat = entry.second;
+        std::cout << std::left << std::setw(16) << entry.first << std::right << std::setw(10) << lat.size()
+                  << std::setw(12) << percentileUs(lat, 0.50) << std::setw(12) << percentileUs(lat, 0.99)
+                  << std::endl;
+    }
+
+    if (!opts.report.empty()) {
+        std::ofstream out(opts.report);
+        out << std::fixed << std::setprecision(3);
+        for (const auto& m : metrics) {
+            out << m.first << " " << m.second << "\n";
+        }
+        if (!out) {
+            std::cerr << "Error: can't write " << opts.report << std::endl;
+        }
+    }
+
+    if (!opts.baseline.empty()) {
+        std::map<std::string, double> base;
+        if (!loadReport(opts.baseline, base)) {
+            std::cerr << "Error: can't read " << opts.baseline << std::endl;
+            return 1;
+        }
+        std::cout << "\n" << std::left << std::setw(24) << "Metric" << std::right << std::setw(14) << "Baseline"
+                  << std::setw(14) << "Current" << std::setw(10) << "Change" << std::endl;
+        for (const auto& m : metrics) {
+            auto it = base.find(m.first);
+            if (it == base.end()) continue;
+            std::cout << std::left << std::setw(24) << m.first << std::right << std::setw(14) << it->second
+                      << std::setw(14) << m.second;
+            if (it->second != 0) {
+                std::ostringstream change;
+                change << std::fixed << std::setprecision(1) << std::showpos
+                       << (m.second - it->second) / it->second * 100 << "%";
+                std::cout << std::setw(10) << change.str();
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    return total.failed ? 1 : 0;
+}
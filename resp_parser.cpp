@@ -1,125 +1,187 @@
 #include "resp_parser.h"
-#include <unistd.h>
+#include "buffer.h"
 #include <stdexcept>
 #include <sstream>
-#include <iostream>
+#include <algorithm>
 
-std::string readLine(int sockfd) {
-    std::string line;
-    char c;
-    while (read(sockfd, &c, 1) == 1) {
-        if (c == '\r') {
-            char next;
-            if (read(sockfd, &next, 1) == 1 && next == '\n') break;
-            // If we get \r but not \n, treat \r as part of the line
-            line += c;
-        } else if (c == '\n') {
-            // Handle \n without \r (common with nc)
-            break;
-        } else {
-            line += c;
+// Bounds that keep a malicious or broken client from making us allocate
+// unbounded memory before a command is even complete
+constexpr size_t MAX_INLINE_SIZE = 64 * 1024;
+constexpr int64_t MAX_BULK_LEN = 512LL * 1024 * 1024;
+constexpr int64_t MAX_ARRAY_LEN = 1024 * 1024;
+
+// Most arguments reserved up front, whatever count a multibulk announces
+constexpr int64_t MAX_ARGS_RESERVE = 1024;
+
+// Extract the line starting at pos (without its \r\n or bare \n, as sent by
+// nc). Returns false if the terminator hasn't arrived yet.
+static bool readLine(const std::string& buf, size_t& pos, std::string& line) {
+    size_t nl = buf.find('\n', pos);
+    if (nl == std::string::npos) {
+        if (buf.size() - pos > MAX_INLINE_SIZE) {
+            throw std::runtime_error("Protocol error: too big inline request");
         }
+        return false;
     }
-    return line;
+
+    size_t end = (nl > pos && buf[nl - 1] == '\r') ? nl - 1 : nl;
+    line.assign(buf, pos, end - pos);
+    pos = nl + 1;
+    return true;
 }
 
-RESPValue parseRESP(int sockfd) {
-    char type;
-    ssize_t n = read(sockfd, &type, 1);
-    if (n != 1) throw std::runtime_error("Failed to read RESP type");
-    
-    std::cout << "DEBUG: Received RESP type: '" << type << "' (ASCII: " << (int)type << ")" << std::endl;
-    
-    // Handle case where we receive a letter instead of RESP type
-    if (type >= 'A' && type <= 'Z') {
-        // This is likely a simple string command, read the rest
-        std::string command = std::string(1, type) + readLine(sockfd);
-        std::cout << "DEBUG: Received simple string command: " << command << std::endl;
-        
-        // Parse the command into an array format
-        std::vector<RESPValue> args;
-        std::istringstream iss(command);
-        std::string token;
-        while (iss >> token) {
-            args.push_back(RESPValue(RESPType::BulkString, token));
-        }
-        return RESPValue(args);
+static int64_t parseLength(const std::string& line, const char* what) {
+    try {
+        size_t used;
+        int64_t n = std::stoll(line, &used);
+        if (used == line.size()) return n;
+    } catch (const std::exception& e) {
+    }
+    throw std::runtime_error(std::string("Protocol error: invalid ") + what);
+}
+
+bool RESPParser::parseInline(const std::string& buf, size_t& pos, RESPValue& out) {
+    std::string line;
+    if (!readLine(buf, pos, line)) return false;
+
+    std::vector<RESPValue> inline_args;
+    std::istringstream iss(line);
+    std::string token;
+    while (iss >> token) {
+        inline_args.push_back(RESPValue(RESPType::BulkString, token));
     }
-    
-    switch (type) {
-        case '+': // Simple String
-            return RESPValue(RESPType::SimpleString, readLine(sockfd));
-        case '-': // Error
-            return RESPValue(RESPType::Error, readLine(sockfd));
-        case ':': { // Integer
-            std::string num = readLine(sockfd);
-            return RESPValue(std::stoll(num));
+    out = RESPValue(std::move(inline_args));
+    return true;
+}
+
+bool RESPParser::parse(const std::string& buf, size_t& pos, RESPValue& out) {
+    std::string line;
+
+    if (multibulk_len == 0) {
+        // Skip blank lines between inline commands
+        while (pos < buf.size() && (buf[pos] == '\r' || buf[pos] == '\n')) {
+            ++pos;
         }
-        case '$': { // Bulk String
-            std::string lenstr = readLine(sockfd);
-            int len = std::stoi(lenstr);
-            if (len == -1) return RESPValue(RESPType::Null, "");
-            std::string str(len, '\0');
-            ssize_t total = 0;
-            while (total < len) {
-                ssize_t r = read(sockfd, &str[total], len - total);
-                if (r <= 0) throw std::runtime_error("Failed to read bulk string");
-                total += r;
-            }
-            // Read trailing \r\n
-            char crlf[2];
-            if (read(sockfd, crlf, 2) != 2 || crlf[0] != '\r' || crlf[1] != '\n')
-                throw std::runtime_error("Malformed bulk string");
-            return RESPValue(RESPType::BulkString, str);
+        if (pos >= buf.size()) return false;
+        if (buf[pos] != '*') return parseInline(buf, pos, out);
+
+        size_t p = pos + 1;
+        if (!readLine(buf, p, line)) return false;
+        int64_t count = parseLength(line, "multibulk length");
+        if (count < -1 || count > MAX_ARRAY_LEN) {
+            throw std::runtime_error("Protocol error: invalid multibulk length");
         }
-        case '*': { // Array
-            std::string countstr = readLine(sockfd);
-            int count = std::stoi(countstr);
-            if (count == -1) return RESPValue(RESPType::Null, "");
-            std::vector<RESPValue> arr;
-            for (int i = 0; i < count; ++i) {
-                arr.push_back(parseRESP(sockfd));
+        pos = p;
+        if (count <= 0) {
+            out = count == 0 ? RESPValue(std::vector<RESPValue>()) : RESPValue(RESPType::Null, "");
+            return true;
+        }
+
+        // The count is only the client's claim: grow with what arrives
+        multibulk_len = count;
+        args.reserve(static_cast<size_t>(std::min<int64_t>(count, MAX_ARGS_RESERVE)));
+    }
+
+    while (multibulk_len > 0) {
+        if (bulk_len == -1) {
+            if (pos >= buf.size()) return false;
+            if (buf[pos] != '$') {
+                throw std::runtime_error(std::string("Protocol error: expected '$', got '") + buf[pos] + "'");
+            }
+            size_t p = pos + 1;
+            if (!readLine(buf, p, line)) return false;
+            int64_t len = parseLength(line, "bulk length");
+            if (len < 0 || len > MAX_BULK_LEN) {
+                throw std::runtime_error("Protocol error: invalid bulk length");
             }
-            return RESPValue(arr);
+            bulk_len = len;
+            pos = p;
         }
-        default:
-            std::cerr << "DEBUG: Unknown RESP type: '" << type << "' (ASCII: " << (int)type << ")" << std::endl;
-            throw std::runtime_error("Unknown RESP type: " + std::string(1, type));
+
+        // Wait until the payload and its trailing \r\n are all buffered
+        size_t len = static_cast<size_t>(bulk_len);
+        if (buf.size() - pos < len + 2) return false;
+        if (buf[pos + len] != '\r' || buf[pos + len + 1] != '\n') {
+            throw std::runtime_error("Malformed bulk string");
+        }
+        args.push_back(RESPValue(RESPType::BulkString, buf.substr(pos, len)));
+        pending_bytes += len;
+        pos += len + 2;
+        bulk_len = -1;
+        multibulk_len--;
     }
+
+    out = RESPValue(std::move(args));
+    args = std::vector<RESPValue>();
+    pending_bytes = 0;
+    return true;
 }
 
-std::string serializeRESP(const RESPValue& value) {
-    std::ostringstream oss;
+// Pre-encoded segments are copied into strings but referenced by reply buffers
+static void appendRaw(std::string& out, const EncodedRESP& raw) {
+    for (const auto& segment : raw.segments) {
+        out.append(*segment);
+    }
+}
+
+static void appendRaw(OutputBuffer& out, const EncodedRESP& raw) {
+    for (const auto& segment : raw.segments) {
+        out.append(segment);
+    }
+}
+
+template <typename Sink>
+static void writeValue(const RESPValue& value, Sink& out) {
     switch (value.type) {
         case RESPType::SimpleString:
-            oss << "+" << value.str << "\r\n";
+            out.append("+", 1);
+            out.append(value.str);
+            out.append("\r\n", 2);
             break;
         case RESPType::Error:
-            oss << "-" << value.str << "\r\n";
+            out.append("-", 1);
+            out.append(value.str);
+            out.append("\r\n", 2);
             break;
-        case RESPType::Integer:
-            oss << ":" << value.integer << "\r\n";
+        case RESPType::Integer: {
+            std::string line = ":" + std::to_string(value.integer) + "\r\n";
+            out.append(line);
             break;
-        case RESPType::BulkString:
-            if (value.str.empty() && value.type == RESPType::Null) {
-                oss << "$-1\r\n";
-            } else {
-                oss << "$" << value.str.size() << "\r\n" << value.str << "\r\n";
-            }
+        }
+        case RESPType::BulkString: {
+            std::string header = "$" + std::to_string(value.str.size()) + "\r\n";
+            out.append(header);
+            out.append(value.str);
+            out.append("\r\n", 2);
             break;
+        }
         case RESPType::Array:
-            if (value.array.empty() && value.type == RESPType::Null) {
-                oss << "*-1\r\n";
-            } else {
-                oss << "*" << value.array.size() << "\r\n";
-                for (const auto& elem : value.array) {
-                    oss << serializeRESP(elem);
-                }
+        case RESPType::Push:
+        case RESPType::Map: {
+            char prefix = value.type == RESPType::Array ? '*' : value.type == RESPType::Push ? '>' : '%';
+            size_t count = value.type == RESPType::Map ? value.array.size() / 2 : value.array.size();
+            std::string header = prefix + std::to_string(count) + "\r\n";
+            out.append(header);
+            for (const auto& elem : value.array) {
+                writeValue(elem, out);
             }
             break;
+        }
         case RESPType::Null:
-            oss << "$-1\r\n";
+            out.append("$-1\r\n", 5);
+            break;
+        case RESPType::Raw:
+            appendRaw(out, *value.raw);
             break;
     }
-    return oss.str();
-} 
\ No newline at end of file
+}
+
+std::string serializeRESP(const RESPValue& value) {
+    std::string out;
+    writeValue(value, out);
+    return out;
+}
+
+void serializeRESP(const RESPValue& value, OutputBuffer& out) {
+    writeValue(value, out);
+}
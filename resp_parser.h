@@ -1,24 +1,75 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <memory>
 #include <cstdint>
 
-enum class RESPType { SimpleString, Error, Integer, BulkString, Array, Null };
+class OutputBuffer;
+
+// Map and Push are RESP3-only and must only be sent to clients that
+// negotiated protocol 3 with HELLO
+enum class RESPType { SimpleString, Error, Integer, BulkString, Array, Null, Raw, Map, Push };
+
+// Already-encoded RESP as immutable segments sent back to back. Large bulk
+// payloads can be segments of their own, shared with wherever they are
+// stored, so replies reference those bytes instead of copying them.
+struct EncodedRESP {
+    std::vector<std::shared_ptr<const std::string>> segments;
+    size_t referenced = 0;  // Bytes of segments owned by someone else
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& segment : segments) {
+            total += segment->size();
+        }
+        return total;
+    }
+};
 
 struct RESPValue {
     RESPType type;
     std::string str; // For SimpleString, Error, BulkString
     int64_t integer = 0; // For Integer
-    std::vector<RESPValue> array; // For Array
+    std::vector<RESPValue> array; // For Array and Push; Map stores key, value, key, value, ...
+    std::shared_ptr<const EncodedRESP> raw; // For Raw: already-encoded RESP, sent verbatim
 
     RESPValue() : type(RESPType::Null) {}
     RESPValue(RESPType t, const std::string& s) : type(t), str(s) {}
     RESPValue(int64_t i) : type(RESPType::Integer), integer(i) {}
     RESPValue(const std::vector<RESPValue>& arr) : type(RESPType::Array), array(arr) {}
+    RESPValue(std::vector<RESPValue>&& arr) : type(RESPType::Array), array(std::move(arr)) {}
+    explicit RESPValue(std::shared_ptr<const EncodedRESP> encoded) : type(RESPType::Raw), raw(std::move(encoded)) {}
 };
 
-std::string readLine(int sockfd);
-RESPValue parseRESP(int sockfd);
+// Incremental parser for client requests: multibulk arrays of bulk strings,
+// or inline commands ("XLEN mystream\n", as sent by nc) on lines that don't
+// start with '*'. A command split across reads resumes where the last read
+// stopped, with the arguments completed so far kept here, so each byte of
+// even a very large command is parsed once.
+class RESPParser {
+public:
+    RESPParser() : multibulk_len(0), bulk_len(-1), pending_bytes(0) {}
+
+    // Parse from buf starting at pos. Returns true with out set once a whole
+    // command has arrived. Otherwise returns false, having advanced pos past
+    // the arguments it took in; the caller may drop those bytes from buf.
+    // Throws std::runtime_error on malformed input.
+    bool parse(const std::string& buf, size_t& pos, RESPValue& out);
+
+    // Bytes of arguments held for the command in progress
+    size_t pendingBytes() const { return pending_bytes; }
+
+private:
+    int64_t multibulk_len;  // Arguments still to come; 0 between commands
+    int64_t bulk_len;  // Length of the argument being read; -1 before its header
+    size_t pending_bytes;
+    std::vector<RESPValue> args;
+
+    bool parseInline(const std::string& buf, size_t& pos, RESPValue& out);
+};
 
 // Serialize a RESPValue to a RESP-encoded string
-std::string serializeRESP(const RESPValue& value); 
\ No newline at end of file
+std::string serializeRESP(const RESPValue& value);
+
+// Serialize a RESPValue straight into a client's reply buffer
+void serializeRESP(const RESPValue& value, OutputBuffer& out);
@@ -1,76 +1,435 @@
 #include "stream.h"
+#include "memory.h"
+#include "partition.h"
+#include "buffer.h"
 #include <chrono>
 #include <sstream>
 #include <algorithm>
 #include <stdexcept>
 #include <set> // Added for std::set
+#include <new>
+
+// Parse a non-empty run of digits into out; false on anything else or overflow
+static bool parseDecimal(const char* p, const char* end, uint64_t& out) {
+    if (p == end) return false;
+    uint64_t value = 0;
+    for (; p != end; ++p) {
+        if (*p < '0' || *p > '9') return false;
+        uint64_t digit = static_cast<uint64_t>(*p - '0');
+        if (value > (UINT64_MAX - digit) / 10) return false;
+        value = value * 10 + digit;
+    }
+    out = value;
+    return true;
+}
+
+bool StreamID::parse(const std::string& str, StreamID& out) {
+    // Range walks parse every entry's ID, so this avoids substrings
+    const char* begin = str.data();
+    const char* end = begin + str.size();
+    size_t dash_pos = str.find('-');
+    if (dash_pos == std::string::npos) {
+        out.seq = 0;
+        return parseDecimal(begin, end, out.ms);
+    }
+    return parseDecimal(begin, begin + dash_pos, out.ms) && parseDecimal(begin + dash_pos + 1, end, out.seq);
+}
+
+// Values this large would be chained into reply buffers by reference
+// anyway, so they are stored in a shareable buffer from the start
+constexpr size_t SHARED_VALUE_MIN = OutputBuffer::SHARE_MIN;
+
+// Approximate footprint of make_shared's control block
+constexpr size_t SHARED_CONTROL_OVERHEAD = 16;
+
+FieldValue::FieldValue(std::string&& value) {
+    if (value.size() >= SHARED_VALUE_MIN) {
+        // Takes over the argument's heap buffer; the bytes are not copied
+        shared = std::make_shared<const std::string>(std::move(value));
+    } else {
+        small = std::move(value);
+    }
+}
+
+size_t FieldValue::memoryUsage() const {
+    if (shared) {
+        return SHARED_CONTROL_OVERHEAD + sizeof(std::string) + stringAllocSize(*shared);
+    }
+    return stringAllocSize(small);
+}
+
+size_t StreamEntry::computeMemoryUsage() const {
+    size_t bytes = sizeof(StreamEntry) + stringAllocSize(id);
+    for (const auto& field : fields) {
+        bytes += MAP_NODE_OVERHEAD + sizeof(field);
+        bytes += stringAllocSize(field.first) + field.second.memoryUsage();
+    }
+    return bytes;
+}
+
+// Encoding bytes not already counted as part of the entry's values
+static size_t encodingMemory(const EncodedRESP& encoding) {
+    return encoding.size() - encoding.referenced;
+}
+
+StreamEntry::~StreamEntry() {
+    std::shared_ptr<const EncodedRESP> cached = std::atomic_load(&encoding);
+    if (cached) {
+        memorySub(encodingMemory(*cached));
+    }
+}
+
+std::shared_ptr<EncodedRESP> StreamEntry::encode() const {
+    // Framing and small values are copied into owned segments; large values
+    // become segments of their own, shared with the entry
+    std::shared_ptr<EncodedRESP> out = std::make_shared<EncodedRESP>();
+    std::string pending = "*2\r\n$" + std::to_string(id.size()) + "\r\n" + id + "\r\n";
+    pending += "*" + std::to_string(fields.size() * 2) + "\r\n";
+    for (const auto& field : fields) {
+        const std::string& value = field.second.str();
+        pending += "$" + std::to_string(field.first.size()) + "\r\n" + field.first + "\r\n";
+        pending += "$" + std::to_string(value.size()) + "\r\n";
+        if (field.second.sharedBuffer()) {
+            out->segments.push_back(std::make_shared<const std::string>(std::move(pending)));
+            out->segments.push_back(field.second.sharedBuffer());
+            out->referenced += value.size();
+            pending = "\r\n";
+        } else {
+            pending += value + "\r\n";
+        }
+    }
+    out->segments.push_back(std::make_shared<const std::string>(std::move(pending)));
+    return out;
+}
+
+std::shared_ptr<const EncodedRESP> StreamEntry::encoded() const {
+    std::shared_ptr<const EncodedRESP> cached = std::atomic_load(&encoding);
+    if (cached) {
+        return cached;
+    }
+
+    // Several readers may race to fill the cache; the first one wins and
+    // the others use its copy
+    std::shared_ptr<const EncodedRESP> fresh = encode();
+    if (std::atomic_compare_exchange_strong(&encoding, &cached, fresh)) {
+        // Counted globally until the entry is freed, not per stream: the
+        // cache is filled by readers that don't hold the write lock
+        memoryAdd(encodingMemory(*fresh));
+        return fresh;
+    }
+    return cached;
+}
+
+void StreamEntry::appendEncoded(OutputBuffer& out) const {
+    std::shared_ptr<const EncodedRESP> enc = std::atomic_load(&encoding);
+    if (!enc) {
+        enc = encode();
+    }
+    for (const auto& segment : enc->segments) {
+        out.append(segment);
+    }
+}
+
+StreamChunk::StreamChunk(uint64_t base_pos)
+    : base(base_pos), count(0), next(nullptr), prev(nullptr), tombstones(0) {
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        deleted[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+StreamChunk::~StreamChunk() {
+    size_t n = count.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < n; ++i) {
+        entry(i).~StreamEntry();
+    }
+}
+
+static void deleteChunk(void* chunk) {
+    delete static_cast<StreamChunk*>(chunk);
+}
+
+Stream::Stream()
+    : head(nullptr), tail(nullptr), first_pos(0), live_count(0), published_end(0), deletions(0), pins(0),
+      end_pos(0), last_live_pos(0),
+      last_id("0-0"), memory_bytes(sizeof(Stream)), entries_added(0),
+      retention_ms(0) {
+    memoryAdd(memory_bytes);
+}
+
+Stream::Stream(std::unique_ptr<PartitionedStream> parts) : Stream() {
+    partitioned = std::move(parts);
+}
+
+Stream::~Stream() {
+    // The last reference is gone, so no reader can be inside these chunks
+    for (StreamChunk* chunk : chunks) {
+        delete chunk;
+    }
+    memorySub(memory_bytes);
+}
+
+StreamChunk* Stream::chunkFor(uint64_t pos) const {
+    return chunks[(pos - chunks.front()->base) / StreamChunk::CAPACITY];
+}
+
+const StreamEntry& Stream::entryAt(uint64_t pos) const {
+    StreamChunk* chunk = chunkFor(pos);
+    return chunk->entry(pos - chunk->base);
+}
+
+bool Stream::isDeleted(uint64_t pos) const {
+    StreamChunk* chunk = chunkFor(pos);
+    return chunk->deleted[pos - chunk->base].load(std::memory_order_relaxed) != 0;
+}
+
+void Stream::releaseEntry(uint64_t pos, const StreamEntry& entry) {
+    if (!indexes.empty()) {
+        unindexEntry(pos, entry);
+    }
+    memory_bytes -= entry.memory;
+    memorySub(entry.memory);
+    live_count.fetch_sub(1, std::memory_order_release);
+}
+
+void Stream::advanceFirst(uint64_t pos) {
+    while (pos < end_pos && isDeleted(pos)) {
+        ++pos;
+    }
+    first_pos.store(pos, std::memory_order_seq_cst);
+    reclaimChunks();
+}
+
+void Stream::reclaimChunks() {
+    // Unlink chunks wholly below first_pos. The tail stays so the writer
+    // always has somewhere to append; it goes once a newer chunk exists.
+    // None go while a snapshot is held, as it may still read them. first_pos
+    // is published before this check, so a pin taken after it starts at the
+    // new first_pos and never needs what is retired here.
+    if (pins.load(std::memory_order_seq_cst) > 0) return;
+
+    uint64_t first = first_pos.load(std::memory_order_relaxed);
+    while (chunks.size() > 1 && chunks.front()->base + StreamChunk::CAPACITY <= first) {
+        StreamChunk* old = chunks.front();
+        chunks.pop_front();
+        head.store(chunks.front(), std::memory_order_release);
+        chunks.front()->prev.store(nullptr, std::memory_order_release);
+
+        memory_bytes -= StreamChunk::overhead();
+        memorySub(StreamChunk::overhead());
+        epochRetire(old, deleteChunk);
+    }
+}
+
+StreamSnapshot Stream::pin() const {
+    // Register before reading first_pos; see reclaimChunks
+    pins.fetch_add(1, std::memory_order_seq_cst);
+
+    // first_pos before deletions: an XDEL that moved first_pos published
+    // its stamp first, so the snapshot counts those entries as deleted
+    StreamSnapshot snap;
+    snap.first = first_pos.load(std::memory_order_seq_cst);
+    snap.deletions = deletions.load(std::memory_order_acquire);
+    snap.end = published_end.load(std::memory_order_acquire);
+    return snap;
+}
+
+void Stream::unpin() const {
+    pins.fetch_sub(1, std::memory_order_release);
+}
+
+static StreamID slotId(const StreamChunk* chunk, size_t slot) {
+    StreamID id;
+    StreamID::parse(chunk->entry(slot).id, id);
+    return id;
+}
+
+size_t Stream::countRange(const StreamID& start, const StreamID& end, const StreamSnapshot& snap) const {
+    EpochGuard guard;
+
+    // IDs grow with position, trimmed and deleted slots included, so each
+    // chunk's part of the range is a run of slots
+    size_t total = 0;
+    for (const StreamChunk* chunk = head.load(std::memory_order_acquire); chunk;
+         chunk = chunk->next.load(std::memory_order_acquire)) {
+        if (chunk->base >= snap.end) break;
+        uint64_t first = std::max(chunk->base, snap.first);
+        uint64_t last = std::min(chunk->base + chunk->count.load(std::memory_order_acquire), snap.end);
+        if (first >= last) continue;
+        size_t lo = static_cast<size_t>(first - chunk->base);
+        size_t hi = static_cast<size_t>(last - chunk->base);
+
+        if (slotId(chunk, hi - 1) < start) continue;
+        if (end < slotId(chunk, lo)) break;
+
+        // First slot not below start, then first slot past end
+        if (slotId(chunk, lo) < start) {
+            size_t low = lo, high = hi - 1;
+            while (low < high) {
+                size_t mid = low + (high - low) / 2;
+                if (slotId(chunk, mid) < start) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            lo = low;
+        }
+        if (end < slotId(chunk, hi - 1)) {
+            size_t low = lo, high = hi - 1;
+            while (low < high) {
+                size_t mid = low + (high - low) / 2;
+                if (end < slotId(chunk, mid)) {
+                    high = mid;
+                } else {
+                    low = mid + 1;
+                }
+            }
+            hi = low;
+        }
+
+        total += hi - lo;
+        if (chunk->tombstones.load(std::memory_order_acquire) > 0) {
+            for (size_t slot = lo; slot < hi; ++slot) {
+                if (chunk->deletedBy(slot, snap.deletions)) --total;
+            }
+        }
+    }
+    return total;
+}
 
 std::string Stream::generateId() {
     auto now = std::chrono::system_clock::now();
-    auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
         now.time_since_epoch()).count();
-    return std::to_string(timestamp) + "-0";
+
+    // Several entries in the same millisecond (or a clock step backwards)
+    // continue the sequence of the last ID instead of repeating it
+    StreamID last;
+    if (StreamID::parse(last_id, last) && timestamp <= last.ms) {
+        return StreamID(last.ms, last.seq + 1).toString();
+    }
+    return StreamID(timestamp, 0).toString();
 }
 
 std::string Stream::parseAndIncrementId(const std::string& id) {
     if (id == "*") {
-        return generateId();
+        last_id = generateId();
+        return last_id;
     }
     
-    // Parse existing ID format: "timestamp-sequence"
-    size_t dash_pos = id.find('-');
-    if (dash_pos == std::string::npos) {
+    // Explicit IDs are "timestamp-sequence" and must be numerically above
+    // the last one: positions follow ID order, which range counting, expiry
+    // and index paging rely on
+    StreamID parsed;
+    if (id.find('-') == std::string::npos || !StreamID::parse(id, parsed)) {
         throw std::runtime_error("Invalid ID format");
     }
-    
-    std::string timestamp_str = id.substr(0, dash_pos);
-    std::string sequence_str = id.substr(dash_pos + 1);
-    
-    try {
-        int64_t timestamp = std::stoll(timestamp_str);
-        int64_t sequence = std::stoll(sequence_str);
-        
-        // If this ID is less than or equal to last_id, increment sequence
-        if (id <= last_id) {
-            // Parse last_id to get its sequence
-            size_t last_dash = last_id.find('-');
-            int64_t last_sequence = std::stoll(last_id.substr(last_dash + 1));
-            sequence = last_sequence + 1;
-        }
-        
-        std::string new_id = std::to_string(timestamp) + "-" + std::to_string(sequence);
-        last_id = new_id;
-        return new_id;
-    } catch (const std::exception& e) {
-        throw std::runtime_error("Invalid ID format");
+    StreamID last;
+    StreamID::parse(last_id, last);
+    if (!(last < parsed)) {
+        throw std::runtime_error("The ID specified in XADD is equal or smaller than the target stream top item");
     }
+    
+    last_id = parsed.toString();
+    return last_id;
 }
 
-std::string Stream::addEntry(const std::map<std::string, std::string>& fields, const std::string& id) {
+std::string Stream::addEntry(FieldMap fields, const std::string& id) {
     if (fields.empty()) {
         throw std::runtime_error("ERR wrong number of arguments for 'xadd' command");
     }
     
     std::string entry_id = parseAndIncrementId(id);
-    entries.emplace_back(entry_id, fields);
-    
+    appendEntry(entry_id, std::move(fields));
     return entry_id;
 }
 
-std::vector<StreamEntry> Stream::getRange(const std::string& start, const std::string& end, int count) {
-    std::vector<StreamEntry> result;
-    
-    for (const auto& entry : entries) {
-        if (entry.id >= start && entry.id <= end) {
-            result.push_back(entry);
-            if (count > 0 && result.size() >= static_cast<size_t>(count)) {
-                break;
+void Stream::addAssignedEntry(const std::string& entry_id, FieldMap fields) {
+    last_id = entry_id;
+    appendEntry(entry_id, std::move(fields));
+}
+
+std::vector<std::string> Stream::addEntries(std::vector<std::pair<std::string, FieldMap>> entries) {
+    std::vector<std::string> ids;
+    ids.reserve(entries.size());
+
+    // Auto IDs read the clock once per run and then just bump the sequence
+    StreamID next;
+    bool have_next = false;
+
+    // Assign every ID before appending anything, so an entry out of order
+    // rejects the whole batch
+    std::string top = last_id;
+    try {
+        for (auto& entry : entries) {
+            if (entry.second.empty()) {
+                throw std::runtime_error("ERR wrong number of arguments for 'xaddbatch' command");
+            }
+
+            if (entry.first == "*") {
+                if (have_next) {
+                    next.seq++;
+                } else {
+                    StreamID::parse(generateId(), next);
+                    have_next = true;
+                }
+                last_id = next.toString();
+                ids.push_back(last_id);
+            } else {
+                ids.push_back(parseAndIncrementId(entry.first));
+                have_next = false;
             }
         }
+    } catch (...) {
+        last_id = top;
+        throw;
     }
-    
-    return result;
-} 
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        appendEntry(ids[i], std::move(entries[i].second));
+    }
+    return ids;
+}
+
+void Stream::appendEntry(const std::string& entry_id, FieldMap&& fields) {
+    StreamChunk* last = chunks.empty() ? nullptr : chunks.back();
+    if (!last || end_pos - last->base == StreamChunk::CAPACITY) {
+        StreamChunk* chunk = new StreamChunk(end_pos);
+        memory_bytes += StreamChunk::overhead();
+        memoryAdd(StreamChunk::overhead());
+
+        chunks.push_back(chunk);
+        chunk->prev.store(last, std::memory_order_relaxed);
+        if (last) {
+            last->next.store(chunk, std::memory_order_release);
+        } else {
+            head.store(chunk, std::memory_order_release);
+        }
+        tail.store(chunk, std::memory_order_release);
+        last = chunk;
+    }
+
+    // Construct in place, then publish: readers never see a partial entry
+    size_t slot = static_cast<size_t>(end_pos - last->base);
+    new (&last->entry(slot)) StreamEntry(entry_id, std::move(fields));
+    last->count.store(slot + 1, std::memory_order_release);
+
+    if (!indexes.empty()) {
+        indexEntry(end_pos, last->entry(slot));
+    }
+
+    last_live_pos = end_pos++;
+    published_end.store(end_pos, std::memory_order_release);
+    live_count.fetch_add(1, std::memory_order_release);
+    entries_added++;
+
+    size_t bytes = last->entry(slot).memory;
+    memory_bytes += bytes;
+    memoryAdd(bytes);
+
+    // The previous tail may have been fully trimmed while it was the tail
+    reclaimChunks();
+}
 
 int Stream::deleteEntries(const std::vector<std::string>& ids) {
     int deleted_count = 0;
@@ -78,31 +437,242 @@ int Stream::deleteEntries(const std::vector<std::string>& ids) {
     // Create a set of IDs to delete for efficient lookup
     std::set<std::string> ids_to_delete(ids.begin(), ids.end());
     
-    // Remove entries that match the IDs to delete
-    entries.erase(
-        std::remove_if(entries.begin(), entries.end(),
-            [&ids_to_delete, &deleted_count](const StreamEntry& entry) {
-                if (ids_to_delete.find(entry.id) != ids_to_delete.end()) {
-                    deleted_count++;
-                    return true; // Remove this entry
-                }
-                return false; // Keep this entry
-            }),
-        entries.end()
-    );
+    // Entries can't be removed from under concurrent readers, so matching
+    // entries are stamped as deleted and skipped from then on, except by
+    // snapshots taken before the stamp was published
+    uint64_t stamp = deletions.load(std::memory_order_relaxed) + 1;
+    uint64_t first = first_pos.load(std::memory_order_relaxed);
+    for (uint64_t pos = first; pos < end_pos; ++pos) {
+        if (isDeleted(pos)) continue;
+
+        StreamChunk* chunk = chunkFor(pos);
+        size_t slot = static_cast<size_t>(pos - chunk->base);
+        const StreamEntry& entry = chunk->entry(slot);
+        if (ids_to_delete.find(entry.id) == ids_to_delete.end()) continue;
+
+        chunk->tombstones.fetch_add(1, std::memory_order_relaxed);
+        chunk->deleted[slot].store(stamp, std::memory_order_release);
+        releaseEntry(pos, entry);
+        deleted_count++;
+    }
+
+    if (deleted_count > 0) {
+        deletions.store(stamp, std::memory_order_release);
+
+        // Keep the cached last entry pointing at a live one
+        while (last_live_pos > first && isDeleted(last_live_pos)) {
+            --last_live_pos;
+        }
+        advanceFirst(first);
+    }
     
     return deleted_count;
 } 
 
 int Stream::trimToLength(size_t max_length) {
-    if (entries.size() <= max_length) {
+    size_t live = length();
+    if (live <= max_length) {
         return 0; // No trimming needed
     }
     
-    int removed_count = entries.size() - max_length;
+    int removed_count = live - max_length;
     
     // Remove the oldest entries (from the beginning)
-    entries.erase(entries.begin(), entries.begin() + removed_count);
+    uint64_t pos = first_pos.load(std::memory_order_relaxed);
+    for (int removed = 0; removed < removed_count; ++pos) {
+        if (isDeleted(pos)) continue;
+        releaseEntry(pos, entryAt(pos));
+        removed++;
+    }
+    advanceFirst(pos);
     
     return removed_count;
-} 
\ No newline at end of file
+}
+
+size_t Stream::trimOldest(size_t bytes_needed, const StreamID* bound) {
+    size_t freed = 0;
+    uint64_t first = first_pos.load(std::memory_order_relaxed);
+    uint64_t pos = first;
+
+    while (pos < end_pos) {
+        if (isDeleted(pos)) {
+            ++pos;
+            continue;
+        }
+
+        const StreamEntry& entry = entryAt(pos);
+        if (pos != first) {
+            if (freed >= bytes_needed) break;
+
+            StreamID id;
+            if (bound && StreamID::parse(entry.id, id) && !(id < *bound)) break;
+        }
+        freed += entry.memory;
+        releaseEntry(pos, entry);
+        ++pos;
+    }
+
+    // Publish the new head once for the whole run
+    advanceFirst(pos);
+
+    return freed;
+}
+
+size_t Stream::expireBefore(uint64_t min_ms, size_t max_entries) {
+    size_t removed = 0;
+    uint64_t pos = first_pos.load(std::memory_order_relaxed);
+
+    // Appends reject IDs at or below the top one, so IDs grow with position
+    // and expired entries always form a prefix of the stream
+    while (pos < end_pos && removed < max_entries) {
+        if (isDeleted(pos)) {
+            ++pos;
+            continue;
+        }
+
+        const StreamEntry& entry = entryAt(pos);
+        StreamID id;
+        if (!StreamID::parse(entry.id, id) || id.ms >= min_ms) break;
+
+        releaseEntry(pos, entry);
+        ++removed;
+        ++pos;
+    }
+
+    if (removed > 0) {
+        advanceFirst(pos);
+    }
+    return removed;
+}
+
+// Approximate footprint of a value's posting list node in a FieldIndex
+static size_t postingListOverhead(const std::string& value) {
+    return MAP_NODE_OVERHEAD + sizeof(FieldIndex::value_type) + stringAllocSize(value);
+}
+
+void Stream::addPosting(FieldIndex& index, const std::string& value, uint64_t pos) {
+    auto it = index.find(value);
+    size_t bytes = sizeof(uint64_t);
+    if (it == index.end()) {
+        it = index.emplace(value, std::deque<uint64_t>()).first;
+        bytes += postingListOverhead(value);
+    }
+    it->second.push_back(pos);
+
+    memory_bytes += bytes;
+    memoryAdd(bytes);
+}
+
+void Stream::indexEntry(uint64_t pos, const StreamEntry& entry) {
+    for (auto& index : indexes) {
+        auto field = entry.fields.find(index.first);
+        if (field != entry.fields.end()) {
+            addPosting(index.second, field->second.str(), pos);
+        }
+    }
+}
+
+void Stream::unindexEntry(uint64_t pos, const StreamEntry& entry) {
+    for (auto& index : indexes) {
+        auto field = entry.fields.find(index.first);
+        if (field == entry.fields.end()) continue;
+
+        auto it = index.second.find(field->second.str());
+        if (it == index.second.end()) continue;
+        std::deque<uint64_t>& postings = it->second;
+
+        // Trimming always removes the oldest posting; XDEL can hit any
+        if (!postings.empty() && postings.front() == pos) {
+            postings.pop_front();
+        } else {
+            auto p = std::lower_bound(postings.begin(), postings.end(), pos);
+            if (p == postings.end() || *p != pos) continue;
+            postings.erase(p);
+        }
+
+        size_t bytes = sizeof(uint64_t);
+        if (postings.empty()) {
+            bytes += postingListOverhead(it->first);
+            index.second.erase(it);
+        }
+        memory_bytes -= bytes;
+        memorySub(bytes);
+    }
+}
+
+bool Stream::createIndex(const std::string& field) {
+    if (indexes.count(field)) {
+        return false;
+    }
+
+    size_t bytes = MAP_NODE_OVERHEAD + sizeof(std::pair<const std::string, FieldIndex>) + stringAllocSize(field);
+    memory_bytes += bytes;
+    memoryAdd(bytes);
+
+    FieldIndex& index = indexes[field];
+    for (uint64_t pos = first_pos.load(std::memory_order_relaxed); pos < end_pos; ++pos) {
+        if (isDeleted(pos)) continue;
+        const StreamEntry& entry = entryAt(pos);
+        auto it = entry.fields.find(field);
+        if (it != entry.fields.end()) {
+            addPosting(index, it->second.str(), pos);
+        }
+    }
+    return true;
+}
+
+bool Stream::dropIndex(const std::string& field) {
+    auto it = indexes.find(field);
+    if (it == indexes.end()) {
+        return false;
+    }
+
+    size_t bytes = MAP_NODE_OVERHEAD + sizeof(std::pair<const std::string, FieldIndex>) + stringAllocSize(field);
+    for (const auto& postings : it->second) {
+        bytes += postingListOverhead(postings.first) + postings.second.size() * sizeof(uint64_t);
+    }
+    indexes.erase(it);
+
+    memory_bytes -= bytes;
+    memorySub(bytes);
+    return true;
+}
+
+std::vector<std::string> Stream::indexedFields() const {
+    std::vector<std::string> fields;
+    for (const auto& index : indexes) {
+        fields.push_back(index.first);
+    }
+    return fields;
+}
+
+std::vector<std::shared_ptr<const EncodedRESP>> Stream::queryIndex(const std::string& field, const std::string& value,
+                                                                   const StreamID* after, int count) const {
+    std::vector<std::shared_ptr<const EncodedRESP>> result;
+
+    const FieldIndex& index = indexes.at(field);
+    auto it = index.find(value);
+    if (it == index.end()) {
+        return result;
+    }
+    const std::deque<uint64_t>& postings = it->second;
+
+    // Postings are in position order, which is ID order since appends
+    // reject IDs at or below the top one, so the page start is a binary
+    // search away
+    auto start = postings.begin();
+    if (after) {
+        start = std::upper_bound(postings.begin(), postings.end(), *after,
+                                 [this](const StreamID& bound, uint64_t pos) {
+                                     StreamID id;
+                                     StreamID::parse(entryAt(pos).id, id);
+                                     return bound < id;
+                                 });
+    }
+
+    for (auto p = start; p != postings.end(); ++p) {
+        if (count > 0 && result.size() >= static_cast<size_t>(count)) break;
+        result.push_back(entryAt(*p).encoded());
+    }
+    return result;
+}
@@ -1,46 +1,377 @@
 #pragma once
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <memory>
+#include <deque>
+#include <atomic>
+#include <type_traits>
+#include <cstdint>
+#include <utility>
+#include <limits>
+#include "epoch.h"
+#include "resp_parser.h"
+
+// Numeric form of a "timestamp-sequence" ID, for ordering across streams
+struct StreamID {
+    uint64_t ms;
+    uint64_t seq;
+
+    StreamID() : ms(0), seq(0) {}
+    StreamID(uint64_t m, uint64_t s) : ms(m), seq(s) {}
+
+    // Accepts "ms-seq" or a bare "ms" (sequence 0)
+    static bool parse(const std::string& str, StreamID& out);
+    std::string toString() const { return std::to_string(ms) + "-" + std::to_string(seq); }
+
+    bool operator<(const StreamID& other) const {
+        return ms < other.ms || (ms == other.ms && seq < other.seq);
+    }
+    bool operator==(const StreamID& other) const { return ms == other.ms && seq == other.seq; }
+};
+
+// A stored field value. Large values are moved out of the command argument
+// into an immutable shared buffer, which every reply then references as a
+// segment of its own; small ones are kept inline and copied into replies.
+class FieldValue {
+public:
+    FieldValue() {}
+    explicit FieldValue(std::string&& value);
+
+    const std::string& str() const { return shared ? *shared : small; }
+    const std::shared_ptr<const std::string>& sharedBuffer() const { return shared; }
+
+    // Heap bytes held for the value
+    size_t memoryUsage() const;
+
+private:
+    std::string small;
+    std::shared_ptr<const std::string> shared;
+};
+
+typedef std::map<std::string, FieldValue> FieldMap;
 
 struct StreamEntry {
     std::string id;  // Format: "timestamp-sequence"
-    std::map<std::string, std::string> fields;  // field-value pairs
-    
-    StreamEntry(const std::string& entry_id, const std::map<std::string, std::string>& f) 
-        : id(entry_id), fields(f) {}
+    FieldMap fields;  // field-value pairs
+    size_t memory;  // Accounted bytes, computed once at construction
+
+    StreamEntry(const std::string& entry_id, FieldMap&& f)
+        : id(entry_id), fields(std::move(f)), memory(computeMemoryUsage()) {}
+    ~StreamEntry();
+
+    // Entries live in place inside their chunk; replies reference them
+    // through encoded() rather than copying them
+    StreamEntry(const StreamEntry&) = delete;
+    StreamEntry& operator=(const StreamEntry&) = delete;
+
+    // RESP encoding of [id, [field, value, ...]], built by the first reader
+    // that needs it and then shared by every reply including this entry.
+    // Safe to call from concurrent readers.
+    std::shared_ptr<const EncodedRESP> encoded() const;
+
+    // Append the encoding to a reply buffer. Uses the cached encoding if a
+    // reader already built one, otherwise encodes on the fly without caching
+    // it, so a scan over a whole stream doesn't leave every encoding behind.
+    void appendEncoded(OutputBuffer& out) const;
+
+private:
+    // Only accessed through std::atomic_load / std::atomic_compare_exchange
+    mutable std::shared_ptr<const EncodedRESP> encoding;
+
+    std::shared_ptr<EncodedRESP> encode() const;
+
+    size_t computeMemoryUsage() const;
+};
+
+// Fixed-size block of entries. The writer constructs entries in place and
+// publishes them by bumping count with release semantics, so readers that
+// load count with acquire may read every slot below it without a lock.
+// Published entries are immutable; XDEL only stamps their slot as deleted.
+struct StreamChunk {
+    static constexpr size_t CAPACITY = 128;
+
+    const uint64_t base;  // Stream position of slots[0]
+    std::atomic<size_t> count;  // Slots published to readers
+    std::atomic<StreamChunk*> next;  // Newer chunk, once the writer links it
+    std::atomic<StreamChunk*> prev;  // Older chunk; cleared before that chunk is retired
+    std::atomic<uint64_t> deleted[CAPACITY];  // Stamp of the XDEL that removed each slot, 0 while live
+    std::atomic<size_t> tombstones;  // Slots stamped so far, so counting can skip clean chunks
+
+    explicit StreamChunk(uint64_t base_pos);
+    ~StreamChunk();
+    StreamChunk(const StreamChunk&) = delete;
+    StreamChunk& operator=(const StreamChunk&) = delete;
+
+    // Whether the slot was removed by an XDEL stamped at or below visible
+    bool deletedBy(size_t slot, uint64_t visible) const {
+        uint64_t stamp = deleted[slot].load(std::memory_order_acquire);
+        return stamp != 0 && stamp <= visible;
+    }
+
+    StreamEntry& entry(size_t slot) { return *reinterpret_cast<StreamEntry*>(&slots[slot]); }
+    const StreamEntry& entry(size_t slot) const { return *reinterpret_cast<const StreamEntry*>(&slots[slot]); }
+
+    // Bytes of the chunk itself, excluding the entries (accounted separately)
+    static constexpr size_t overhead() { return sizeof(StreamChunk) - CAPACITY * sizeof(StreamEntry); }
+
+private:
+    typename std::aligned_storage<sizeof(StreamEntry), alignof(StreamEntry)>::type slots[CAPACITY];
+};
+
+class PartitionedStream;
+
+// Where a traversal that spans several epoch sections resumes. It remembers
+// the chunk it stopped in, so resuming is O(1) rather than a walk from the
+// head; the chunk is only trusted while it still holds untrimmed positions,
+// since until then it can't have been retired.
+struct StreamBookmark {
+    uint64_t pos = 0;  // Forward: next position to visit. Reverse: visit below it.
+    const StreamChunk* chunk = nullptr;  // Chunk holding the last visited entry
+    uint64_t chunk_base = 0;
 };
 
+// The stream as a paused reader (a range reply) saw it when it started:
+// positions [first, end), less the entries deleted by then. While one is
+// held no chunk is reclaimed, so entries trimmed or deleted later can still
+// be read through it.
+struct StreamSnapshot {
+    uint64_t first;
+    uint64_t end;
+    uint64_t deletions;  // Slots stamped above this were deleted afterwards
+};
+
+// Secondary index on one field: each value maps to the positions of the
+// live entries holding it, in append (ID) order
+typedef std::unordered_map<std::string, std::deque<uint64_t>> FieldIndex;
+
+// A stream with one writer and any number of lock-free readers.
+//
+// Every entry gets a position (its index in append order). Chunks form a
+// singly linked list from head to tail; positions below first_pos have been
+// trimmed. Mutating methods must be called by one thread at a time (the
+// command write lock); length() and forEachEntry() may run concurrently
+// with them. Chunks that fall entirely below first_pos are unlinked and
+// handed to epoch-based reclamation, so a reader still walking one is safe.
 class Stream {
 private:
-    std::vector<StreamEntry> entries;
+    std::atomic<StreamChunk*> head;  // Oldest chunk still linked
+    std::atomic<StreamChunk*> tail;  // Newest chunk, where reverse traversals start
+    std::atomic<uint64_t> first_pos;  // First position not trimmed
+    std::atomic<size_t> live_count;  // Entries neither trimmed nor deleted
+    std::atomic<uint64_t> published_end;  // end_pos as last published to readers
+    std::atomic<uint64_t> deletions;  // Stamp of the latest XDEL, published after its slots
+    mutable std::atomic<int> pins;  // Snapshots held; no chunk is reclaimed while any is
+
+    // Writer-side state
+    std::deque<StreamChunk*> chunks;  // Same chunks as the linked list, for O(1) position lookup
+    uint64_t end_pos;  // Next position to be written
+    uint64_t last_live_pos;  // Position of the newest live entry (if live_count > 0)
     std::string last_id;  // Last generated ID for auto-incrementing sequence
+    size_t memory_bytes;  // Stream overhead plus the memory of every entry
+    uint64_t entries_added;  // Entries added over the stream's lifetime
+    uint64_t retention_ms;  // Max entry age enforced by active expiry (0 = keep forever)
+    std::map<std::string, FieldIndex> indexes;  // Field name -> index (opt-in)
+    std::unique_ptr<PartitionedStream> partitioned;  // Set for partitioned keys, which hold no entries themselves
+
+    StreamChunk* chunkFor(uint64_t pos) const;
+    const StreamEntry& entryAt(uint64_t pos) const;
+    bool isDeleted(uint64_t pos) const;
+
+    // Construct and publish an entry whose ID has already been assigned
+    void appendEntry(const std::string& entry_id, FieldMap&& fields);
+
+    // Account for an entry leaving the stream (trimmed or deleted)
+    void releaseEntry(uint64_t pos, const StreamEntry& entry);
+
+    // Keep the secondary indexes in step with entries coming and going
+    void indexEntry(uint64_t pos, const StreamEntry& entry);
+    void unindexEntry(uint64_t pos, const StreamEntry& entry);
+    void addPosting(FieldIndex& index, const std::string& value, uint64_t pos);
+
+    // Move first_pos past trimmed entries and leading tombstones, publish
+    // it, and retire chunks nobody can reach anymore
+    void advanceFirst(uint64_t pos);
+    void reclaimChunks();
 
 public:
-    Stream() : last_id("0-0") {}
-    
-    // Add an entry to the stream
-    std::string addEntry(const std::map<std::string, std::string>& fields, const std::string& id = "*");
-    
-    // Get entries in a range
-    std::vector<StreamEntry> getRange(const std::string& start, const std::string& end, int count = -1);
-    
-    // Get stream length
-    size_t length() const { return entries.size(); }
-    
-    // Get all entries (for XREAD)
-    const std::vector<StreamEntry>& getEntries() const { return entries; }
-    
+    Stream();
+    explicit Stream(std::unique_ptr<PartitionedStream> parts);
+    ~Stream();
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    // Add an entry to the stream. Fields are taken by value so callers can
+    // move them in: values then reach the entry without being copied.
+    std::string addEntry(FieldMap fields, const std::string& id = "*");
+
+    // Append with an ID the caller has already checked is above every ID
+    // in the stream (partitioned streams assign IDs across partitions)
+    void addAssignedEntry(const std::string& entry_id, FieldMap fields);
+
+    // The partitions if this key is a partitioned stream, else nullptr.
+    // Commands route appends and reads through it instead of this stream.
+    PartitionedStream* partitions() const { return partitioned.get(); }
+
+    // Add several (id, fields) entries in one pass; returns their IDs. All
+    // "*" entries in a row share one clock read and get consecutive sequences.
+    std::vector<std::string> addEntries(std::vector<std::pair<std::string, FieldMap>> entries);
+
+    // Get stream length (safe to call concurrently with the writer)
+    size_t length() const { return live_count.load(std::memory_order_acquire); }
+
+    // Visit live entries oldest first until fn returns false. Safe to call
+    // concurrently with the writer: the traversal runs under an EpochGuard.
+    template <typename Fn>
+    void forEachEntry(Fn fn) const;
+
+    // Same, starting at position pos and calling fn(position, entry), so a
+    // tailing reader can resume where it stopped (safe to call concurrently)
+    template <typename Fn>
+    void forEachEntryFrom(uint64_t pos, Fn fn) const;
+
+    // Resumable forms for readers that pause between epoch sections (range
+    // replies streamed as the socket drains). Both call fn(position, entry)
+    // and leave mark where the next call picks up: forward from mark.pos, or
+    // newest first below mark.pos (start reverse walks at UINT64_MAX).
+    // Given a snapshot they see the stream as it was when it was taken.
+    template <typename Fn>
+    void forEachEntryFrom(StreamBookmark& mark, Fn fn, const StreamSnapshot* snap = nullptr) const;
+    template <typename Fn>
+    void forEachEntryBefore(StreamBookmark& mark, Fn fn, const StreamSnapshot* snap = nullptr) const;
+
+    // Take and release a snapshot (safe to call concurrently). Chunks that
+    // fall behind while one is held are reclaimed by the first trim or XDEL
+    // after the last is released.
+    StreamSnapshot pin() const;
+    void unpin() const;
+
+    // Live entries of a snapshot with IDs in [start, end] (safe to call
+    // concurrently). Reads one or two IDs per chunk and binary searches
+    // the chunks at either end of the range; entries aren't visited.
+    size_t countRange(const StreamID& start, const StreamID& end, const StreamSnapshot& snap) const;
+
+    // Position the next appended entry will get (safe to call concurrently)
+    uint64_t endPosition() const { return published_end.load(std::memory_order_acquire); }
+
+    // O(1) metadata for XINFO / MEMORY USAGE / eviction. Writer side only;
+    // first/last require length() > 0.
+    const StreamEntry& firstEntry() const { return entryAt(first_pos.load(std::memory_order_relaxed)); }
+    const StreamEntry& lastEntry() const { return entryAt(last_live_pos); }
+    const std::string& lastGeneratedId() const { return last_id; }
+    uint64_t entriesAdded() const { return entries_added; }
+    size_t memoryUsage() const { return memory_bytes; }
+
     // Delete entries by ID
     int deleteEntries(const std::vector<std::string>& ids);
-    
+
     // Trim stream to maximum length
     int trimToLength(size_t max_length);
-    
+
+    // Evict entries from the head until bytes_needed have been released or
+    // the next entry is not older than bound (if given). Always evicts at
+    // least one entry from a non-empty stream. Returns bytes released.
+    size_t trimOldest(size_t bytes_needed, const StreamID* bound);
+
+    // Time-based retention, judged by the millisecond part of entry IDs
+    uint64_t retention() const { return retention_ms; }
+    void setRetention(uint64_t ms) { retention_ms = ms; }
+
+    // Remove at most max_entries of the oldest entries whose ID time is
+    // below min_ms. Returns the number removed; fewer than max_entries means
+    // nothing older than min_ms is left.
+    size_t expireBefore(uint64_t min_ms, size_t max_entries);
+
+    // Secondary field-value indexes (writer side). createIndex indexes the
+    // entries already in the stream; both return false if nothing changed.
+    bool createIndex(const std::string& field);
+    bool dropIndex(const std::string& field);
+    bool hasIndex(const std::string& field) const { return indexes.count(field) > 0; }
+    std::vector<std::string> indexedFields() const;
+
+    // Encoded entries whose indexed field equals value, oldest first,
+    // starting after the given ID (if any) and returning at most count
+    // entries (all if count <= 0). field must be indexed.
+    std::vector<std::shared_ptr<const EncodedRESP>> queryIndex(const std::string& field, const std::string& value,
+                                                               const StreamID* after, int count) const;
+
     // Generate next ID based on current timestamp
     std::string generateId();
-    
-    // Parse ID and increment sequence if needed
+
+    // The ID for the next append: "*" generates one, and an explicit ID
+    // must be above the last. Throws otherwise.
     std::string parseAndIncrementId(const std::string& id);
-}; 
\ No newline at end of file
+};
+
+template <typename Fn>
+void Stream::forEachEntry(Fn fn) const {
+    forEachEntryFrom(0, [&](uint64_t, const StreamEntry& entry) { return fn(entry); });
+}
+
+template <typename Fn>
+void Stream::forEachEntryFrom(uint64_t pos, Fn fn) const {
+    StreamBookmark mark;
+    mark.pos = pos;
+    forEachEntryFrom(mark, fn);
+}
+
+template <typename Fn>
+void Stream::forEachEntryFrom(StreamBookmark& mark, Fn fn, const StreamSnapshot* snap) const {
+    EpochGuard guard;
+
+    uint64_t first = snap ? snap->first : first_pos.load(std::memory_order_acquire);
+    uint64_t end = snap ? snap->end : std::numeric_limits<uint64_t>::max();
+    uint64_t visible = snap ? snap->deletions : std::numeric_limits<uint64_t>::max();
+    const StreamChunk* chunk = mark.chunk;
+    if (!chunk || mark.chunk_base + StreamChunk::CAPACITY <= first) {
+        chunk = head.load(std::memory_order_acquire);
+    }
+    uint64_t pos = mark.pos < first ? first : mark.pos;
+
+    for (; chunk; chunk = chunk->next.load(std::memory_order_acquire)) {
+        size_t count = chunk->count.load(std::memory_order_acquire);
+        if (chunk->base + count <= pos) continue;
+        size_t slot = pos > chunk->base ? static_cast<size_t>(pos - chunk->base) : 0;
+
+        for (; slot < count; ++slot) {
+            if (chunk->base + slot >= end) return;
+            if (chunk->deletedBy(slot, visible)) continue;
+            mark.pos = chunk->base + slot + 1;
+            mark.chunk = chunk;
+            mark.chunk_base = chunk->base;
+            if (!fn(chunk->base + slot, chunk->entry(slot))) return;
+        }
+    }
+}
+
+template <typename Fn>
+void Stream::forEachEntryBefore(StreamBookmark& mark, Fn fn, const StreamSnapshot* snap) const {
+    EpochGuard guard;
+
+    uint64_t first = snap ? snap->first : first_pos.load(std::memory_order_acquire);
+    uint64_t below = snap && snap->end < mark.pos ? snap->end : mark.pos;
+    uint64_t visible = snap ? snap->deletions : std::numeric_limits<uint64_t>::max();
+    if (below <= first) return;
+    const StreamChunk* chunk = mark.chunk;
+    if (!chunk || mark.chunk_base + StreamChunk::CAPACITY <= first) {
+        chunk = tail.load(std::memory_order_acquire);
+    }
+
+    for (; chunk; chunk = chunk->prev.load(std::memory_order_acquire)) {
+        if (chunk->base >= below) continue;
+        size_t count = chunk->count.load(std::memory_order_acquire);
+        size_t slot = below - chunk->base < count ? static_cast<size_t>(below - chunk->base) : count;
+
+        while (slot > 0) {
+            --slot;
+            uint64_t pos = chunk->base + slot;
+            if (pos < first) return;
+            if (chunk->deletedBy(slot, visible)) continue;
+            mark.pos = pos;
+            mark.chunk = chunk;
+            mark.chunk_base = chunk->base;
+            if (!fn(pos, chunk->entry(slot))) return;
+        }
+    }
+}
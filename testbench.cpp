@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <cstring>
+#include <cstdlib>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -52,6 +53,68 @@ private:
         return response;
     }
     
+    // Send several newline-separated commands in one write and read until
+    // the expected number of single-line replies has arrived
+    std::string sendPipeline(const std::string& commands, int expected_lines) {
+        write(sockfd, commands.c_str(), commands.length());
+        write(sockfd, "\n", 1);
+        return readLines(sockfd, expected_lines);
+    }
+    
+    // Read from fd until expected_lines lines have arrived
+    std::string readLines(int fd, int expected_lines) {
+        std::string response;
+        char buffer[1024];
+        int lines = 0;
+        while (lines < expected_lines) {
+            int n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            for (int i = 0; i < n; ++i) {
+                if (buffer[i] == '\n') lines++;
+            }
+            response.append(buffer, n);
+        }
+        
+        return response;
+    }
+    
+    // Read from fd until the data received so far ends with suffix
+    std::string readUntil(int fd, const std::string& suffix) {
+        std::string response;
+        char buffer[1024];
+        while (response.size() < suffix.size() ||
+               response.compare(response.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            int n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            response.append(buffer, n);
+        }
+        return response;
+    }
+    
+    // An extra connection to the server, or -1
+    int openConnection() {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        sockaddr_in server_addr;
+        std::memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(PORT);
+        server_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        if (::connect(fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    
+    // The used-memory field of a MEMORY STATS reply, or -1
+    long long usedMemory(const std::string& stats) {
+        const std::string field = "used-memory\r\n:";
+        size_t pos = stats.find(field);
+        if (pos == std::string::npos) return -1;
+        return std::stoll(stats.substr(pos + field.size()));
+    }
+    
     void disconnect() {
         if (sockfd >= 0) {
             close(sockfd);
@@ -82,6 +145,17 @@ public:
         testXREAD();
         testXDEL();
         testXTRIM();
+        testMemory();
+        testPipelining();
+        testRetention();
+        testTransactions();
+        testSubscriptions();
+        testIndex();
+        testKeyspace();
+        testPartitions();
+        testLargeValues();
+        testCapture();
+        testAdmission();
         testEdgeCases();
         
         std::cout << "\n=== All tests completed ===" << std::endl;
@@ -104,15 +178,27 @@ public:
     void testXADD() {
         std::cout << "\n--- Testing XADD ---" << std::endl;
         
+        // Test XADD with manual ID
+        std::cout << "Testing XADD with manual ID..." << std::endl;
+        std::string xadd_manual_response = sendCommand("XADD mystream 1234567890-0 name alex age 40");
+        std::cout << "XADD manual ID response: " << xadd_manual_response << std::endl;
+        
         // Test basic XADD
         std::cout << "Testing XADD with auto-generated ID..." << std::endl;
         std::string xadd_response = sendCommand("XADD mystream * field1 value1 field2 value2");
         std::cout << "XADD response: " << xadd_response << std::endl;
         
-        // Test XADD with manual ID
-        std::cout << "Testing XADD with manual ID..." << std::endl;
-        std::string xadd_manual_response = sendCommand("XADD mystream 1234567890-0 name alex age 40");
-        std::cout << "XADD manual ID response: " << xadd_manual_response << std::endl;
+        // Test that explicit IDs must be numerically above the top one
+        std::cout << "Testing XADD ID ordering..." << std::endl;
+        std::string xadd_stale_response = sendCommand("XADD mystream 1234567890-0 name alex age 40");
+        std::cout << "XADD below the top ID response: " << xadd_stale_response << std::endl;
+        sendCommand("XADD orderstream 9-0 n 1");
+        std::string xadd_numeric_response = sendCommand("XADD orderstream 10-0 n 2");
+        std::cout << "XADD 10-0 after 9-0 response (expected 10-0): " << xadd_numeric_response << std::endl;
+        std::string xaddbatch_stale_response = sendCommand("XADDBATCH orderstream 11-0 1 n 3 5-0 1 n 4");
+        std::cout << "XADDBATCH with an ID out of order response: " << xaddbatch_stale_response << std::endl;
+        std::string order_len_response = sendCommand("XLEN orderstream");
+        std::cout << "XLEN orderstream response (expected 2): " << order_len_response << std::endl;
         
         // Test XADD with multiple fields
         std::cout << "Testing XADD with multiple fields..." << std::endl;
@@ -151,6 +237,63 @@ public:
         std::cout << "Testing XRANGE on non-existent stream..." << std::endl;
         std::string xrange_nonexistent_response = sendCommand("XRANGE nonexistentstream - +");
         std::cout << "XRANGE non-existent response: " << xrange_nonexistent_response << std::endl;
+        
+        // Test XREVRANGE, which takes the bounds highest first
+        std::cout << "Testing XREVRANGE + - with COUNT..." << std::endl;
+        std::string xrevrange_response = sendCommand("XREVRANGE mystream + - COUNT 2");
+        std::cout << "XREVRANGE with COUNT response: " << xrevrange_response << std::endl;
+        
+        // Test a range too large for one chunk, followed by a pipelined command
+        std::cout << "Testing a streamed XRANGE of 2000 entries..." << std::endl;
+        std::string batch = "XADDBATCH rangestream";
+        for (int i = 0; i < 2000; ++i) {
+            batch += " * 1 n " + std::to_string(i);
+        }
+        sendPipeline(batch, 1 + 2000 * 2);
+        std::string streamed_response = sendPipeline("XRANGE rangestream - +\nPING", 1 + 2000 * 8 + 1);
+        bool complete = streamed_response.compare(0, 7, "*2000\r\n") == 0 &&
+                        streamed_response.find("$4\r\n1999\r\n+PONG\r\n") != std::string::npos;
+        std::cout << "Streamed XRANGE complete and followed by PONG (expected yes): " << (complete ? "yes" : "no") << std::endl;
+        
+        // Test that entries deleted and trimmed while a range is still being
+        // sent are delivered as announced: the reply is large enough to stall
+        // on the socket, and another connection empties the stream meanwhile
+        std::cout << "Testing a streamed XRANGE across XDEL and XTRIM..." << std::endl;
+        std::string pad(4000, 'x');
+        std::string adds;
+        for (int i = 1001; i <= 3000; ++i) {
+            adds += "XADD stallstream " + std::to_string(i) + "-0 n " + std::to_string(i) + " p " + pad + "\n";
+        }
+        sendPipeline(adds.substr(0, adds.size() - 1), 2000 * 2);
+        std::string range = "XRANGE stallstream - +\nPING\n";
+        write(sockfd, range.c_str(), range.length());
+        usleep(200000);
+        int other = openConnection();
+        std::string removes = "XDEL stallstream 2000-0\nXTRIM stallstream MAXLEN 0\n";
+        write(other, removes.c_str(), removes.length());
+        readLines(other, 2);
+        close(other);
+        std::string stalled_response = readUntil(sockfd, "+PONG\r\n");
+        bool intact = stalled_response.compare(0, 7, "*2000\r\n") == 0 &&
+                      stalled_response.find("$-1\r\n") == std::string::npos &&
+                      stalled_response.find("$6\r\n2000-0\r\n") != std::string::npos &&
+                      stalled_response.find("$6\r\n3000-0\r\n") != std::string::npos;
+        std::cout << "All 2000 entries sent, none as nil (expected yes): " << (intact ? "yes" : "no") << std::endl;
+        std::string trimmed_response = sendCommand("XLEN stallstream");
+        std::cout << "XLEN after the trim (expected 0): " << trimmed_response << std::endl;
+        
+        // Test that a range over a stream that refused an out-of-order ID
+        // announces what it sends, so a pipelined command still gets a reply
+        std::cout << "Testing XRANGE after an out-of-order explicit ID..." << std::endl;
+        sendCommand("XADD orderedrange 100-0 f v");
+        std::string low_response = sendCommand("XADD orderedrange 50-0 f v");
+        std::cout << "XADD 50-0 after 100-0 response: " << low_response << std::endl;
+        sendCommand("XADD orderedrange 200-0 f v");
+        std::string ordered_response = sendPipeline("XRANGE orderedrange 100 +\nPING", 1 + 2 * 8 + 1);
+        bool answered = ordered_response.compare(0, 4, "*2\r\n") == 0 &&
+                        ordered_response.find("+PONG\r\n") != std::string::npos;
+        std::cout << "XRANGE orderedrange 100 + announces 2 entries, then PONG (expected yes): "
+                  << (answered ? "yes" : "no") << std::endl;
     }
     
     void testXREAD() {
@@ -170,6 +313,61 @@ public:
         std::string last_id = "1234567890-0"; // Use a known ID for testing
         std::string xread_new_response = sendCommand("XREAD STREAMS mystream " + last_id);
         std::cout << "XREAD for new entries response: " << xread_new_response << std::endl;
+        
+        // Test a repeated read is served from the entry's cached encoding:
+        // the first read builds it (counted in used-memory), later ones reuse it
+        std::cout << "Testing repeated XREAD of the same entry..." << std::endl;
+        sendCommand("XADD encodedstream 1-0 field cached");
+        long long used_before = usedMemory(sendCommand("MEMORY STATS"));
+        std::string first_read = sendCommand("XREAD STREAMS encodedstream 0");
+        long long used_first = usedMemory(sendCommand("MEMORY STATS"));
+        std::string second_read = sendCommand("XREAD STREAMS encodedstream 0");
+        long long used_second = usedMemory(sendCommand("MEMORY STATS"));
+        std::cout << "Identical replies (expected yes): " << (first_read == second_read ? "yes" : "no") << std::endl;
+        std::cout << "Encoding cached once (expected yes): "
+                  << (used_first > used_before && used_second == used_first ? "yes" : "no") << std::endl;
+        
+        // Test reads on another connection while a writer appends: readers
+        // never see the stream shrink, and get every entry in order
+        std::cout << "Testing XLEN/XREAD while another connection appends..." << std::endl;
+        std::thread writer([this]() {
+            int fd = openConnection();
+            if (fd < 0) return;
+            std::string batch;
+            for (int i = 0; i < 2000; ++i) {
+                batch += "XADD concurrentstream * n " + std::to_string(i) + "\n";
+            }
+            write(fd, batch.c_str(), batch.length());
+            char buffer[4096];
+            int lines = 0;
+            while (lines < 2000 * 2) {
+                int n = read(fd, buffer, sizeof(buffer));
+                if (n <= 0) break;
+                for (int i = 0; i < n; ++i) {
+                    if (buffer[i] == '\n') lines++;
+                }
+            }
+            close(fd);
+        });
+        bool monotonic = true;
+        long long last_len = 0;
+        for (int i = 0; i < 50; ++i) {
+            std::string len_response = sendCommand("XLEN concurrentstream");
+            long long len = len_response.size() > 1 ? std::atoll(len_response.c_str() + 1) : -1;
+            if (len < last_len) monotonic = false;
+            last_len = len;
+        }
+        writer.join();
+        std::string all_response = sendPipeline("XREAD STREAMS concurrentstream 0", 4 + 2000 * 8);
+        bool in_order = true;
+        size_t pos = 0;
+        for (int i = 0; i < 2000 && in_order; ++i) {
+            std::string n = std::to_string(i);
+            pos = all_response.find("\r\nn\r\n$" + std::to_string(n.size()) + "\r\n" + n + "\r\n", pos);
+            in_order = pos != std::string::npos;
+        }
+        std::cout << "XLEN never decreased (expected yes): " << (monotonic ? "yes" : "no") << std::endl;
+        std::cout << "All 2000 entries read in order (expected yes): " << (in_order ? "yes" : "no") << std::endl;
     }
     
     void testXDEL() {
@@ -232,6 +430,438 @@ public:
         std::cout << "XRANGE after trim: " << xrange_after_trim_response << std::endl;
     }
     
+    void testMemory() {
+        std::cout << "\n--- Testing Memory Accounting ---" << std::endl;
+        
+        // Test MEMORY USAGE on existing and non-existent streams
+        std::cout << "Testing MEMORY USAGE..." << std::endl;
+        std::string usage_response = sendCommand("MEMORY USAGE mystream");
+        std::cout << "MEMORY USAGE response: " << usage_response << std::endl;
+        std::string usage_nonexistent_response = sendCommand("MEMORY USAGE nonexistentstream");
+        std::cout << "MEMORY USAGE non-existent response: " << usage_nonexistent_response << std::endl;
+        
+        // Test XINFO STREAM
+        std::cout << "Testing XINFO STREAM..." << std::endl;
+        std::string xinfo_response = sendCommand("XINFO STREAM trimstream");
+        std::cout << "XINFO STREAM response: " << xinfo_response << std::endl;
+        
+        // Test that a size overflowing 64 bits is refused rather than wrapped
+        std::cout << "Testing CONFIG SET maxmemory overflow..." << std::endl;
+        std::string overflow_response = sendCommand("CONFIG SET maxmemory 99999999999gb");
+        std::cout << "CONFIG SET maxmemory 99999999999gb response: " << overflow_response << std::endl;
+        std::string unchanged_response = sendCommand("CONFIG GET maxmemory");
+        std::cout << "CONFIG GET maxmemory response (expected 0): " << unchanged_response << std::endl;
+        
+        // Test maxmemory with noeviction: writes are refused
+        std::cout << "Testing maxmemory noeviction..." << std::endl;
+        sendCommand("CONFIG SET maxmemory 1");
+        std::string oom_response = sendCommand("XADD memstream * field value");
+        std::cout << "XADD over maxmemory response: " << oom_response << std::endl;
+        
+        // Test maxmemory with trim-oldest: oldest entries are evicted. IDs
+        // from 1-0 up are older than any other test's, so they go first.
+        std::cout << "Testing maxmemory trim-oldest..." << std::endl;
+        sendCommand("CONFIG SET maxmemory 0");
+        std::string batch = "XADDBATCH evictstream";
+        for (int i = 1; i <= 200; ++i) {
+            batch += " " + std::to_string(i) + "-0 1 field " + std::string(100, 'x');
+        }
+        sendPipeline(batch, 1 + 200 * 2);
+        std::string stats_response = sendCommand("MEMORY STATS");
+        std::cout << "MEMORY STATS response: " << stats_response << std::endl;
+        long long used_before = usedMemory(stats_response);
+        long long limit = used_before - 10000;
+        sendCommand("CONFIG SET maxmemory-policy trim-oldest");
+        std::string policy_response = sendCommand("CONFIG GET maxmemory-policy");
+        std::cout << "CONFIG GET maxmemory-policy response: " << policy_response << std::endl;
+        sendCommand("CONFIG SET maxmemory " + std::to_string(limit));
+        std::string evict_response = sendCommand("XADD evictstream * field value");
+        std::cout << "XADD over maxmemory with trim-oldest response: " << evict_response << std::endl;
+        
+        // The write evicts before it appends; the next background tick
+        // evicts for the appended entry too
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        std::string xlen_response = sendCommand("XLEN evictstream");
+        std::cout << "XLEN after eviction response (expected below 201): " << xlen_response << std::endl;
+        std::string first_response = sendCommand("XRANGE evictstream - + COUNT 1");
+        bool oldest_gone = first_response.find("\r\n1-0\r\n") == std::string::npos;
+        std::cout << "Oldest entry evicted (expected yes): " << (oldest_gone ? "yes" : "no") << std::endl;
+        long long used_after = usedMemory(sendCommand("MEMORY STATS"));
+        std::cout << "used-memory back under maxmemory (expected yes): "
+                  << (used_after <= limit ? "yes" : "no") << std::endl;
+        sendCommand("CONFIG SET maxmemory 0");
+        sendCommand("CONFIG SET maxmemory-policy noeviction");
+        sendCommand("DEL evictstream");
+    }
+    
+    void testPipelining() {
+        std::cout << "\n--- Testing Pipelining and Output Buffers ---" << std::endl;
+        
+        // Test several commands in a single write
+        std::cout << "Testing pipelined commands..." << std::endl;
+        std::string pipelined_response = sendPipeline("PING\nXLEN trimstream\nPING", 3);
+        std::cout << "Pipelined response: " << pipelined_response << std::endl;
+        
+        // Test one write of large requests, each spanning several 16 KB
+        // receive buffers, and the reply that returns them
+        std::cout << "Testing a large pipelined request and reply..." << std::endl;
+        std::string value;
+        for (int i = 0; i < 40000; ++i) {
+            value += static_cast<char>('a' + (i * 7) % 26);
+        }
+        std::string requests;
+        for (int i = 0; i < 64; ++i) {
+            requests += "*5\r\n$4\r\nXADD\r\n$7\r\nbigpipe\r\n$1\r\n*\r\n$4\r\ndata\r\n$40000\r\n" + value + "\r\n";
+        }
+        std::string large_response = sendPipeline(requests + "PING", 64 * 2 + 1);
+        bool acknowledged = large_response.find("+PONG") != std::string::npos;
+        std::cout << "All 64 large XADDs acknowledged (expected yes): " << (acknowledged ? "yes" : "no") << std::endl;
+        std::string range_response = sendPipeline("XRANGE bigpipe - +", 1 + 64 * 8);
+        int intact = 0;
+        for (size_t pos = 0; (pos = range_response.find("$40000\r\n" + value + "\r\n", pos)) != std::string::npos; ++pos) {
+            intact++;
+        }
+        std::cout << "Values returned intact (expected 64): " << intact << std::endl;
+        sendCommand("DEL bigpipe");
+        
+        // Test output buffer limit configuration
+        std::cout << "Testing CONFIG GET client-output-buffer-limit..." << std::endl;
+        std::string limit_response = sendCommand("CONFIG GET client-output-buffer-limit");
+        std::cout << "CONFIG GET client-output-buffer-limit response: " << limit_response << std::endl;
+    }
+    
+    void testRetention() {
+        std::cout << "\n--- Testing Time-Based Retention ---" << std::endl;
+        
+        // Entries with old explicit IDs expire; the fresh one is kept
+        std::cout << "Adding old and current entries..." << std::endl;
+        sendCommand("XADD retentionstream 1000-0 field old1");
+        sendCommand("XADD retentionstream 2000-0 field old2");
+        sendCommand("XADD retentionstream * field current");
+        
+        // An old ID can't land behind the current entry, where expiry,
+        // which stops at the first entry it keeps, would never reach it
+        std::string late_response = sendCommand("XADD retentionstream 1500-0 field late");
+        std::cout << "XADD of an old ID after a current one response: " << late_response << std::endl;
+        
+        std::cout << "Testing XRETENTION..." << std::endl;
+        std::string set_response = sendCommand("XRETENTION retentionstream 3600000");
+        std::cout << "XRETENTION set response: " << set_response << std::endl;
+        std::string get_response = sendCommand("XRETENTION retentionstream");
+        std::cout << "XRETENTION get response: " << get_response << std::endl;
+        
+        // Give the active expiry cycle a few ticks
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        std::string xlen_response = sendCommand("XLEN retentionstream");
+        std::cout << "XLEN after expiry response (expected 1): " << xlen_response << std::endl;
+        
+        std::string nonexistent_response = sendCommand("XRETENTION nonexistentstream 1000");
+        std::cout << "XRETENTION non-existent response: " << nonexistent_response << std::endl;
+    }
+    
+    void testTransactions() {
+        std::cout << "\n--- Testing MULTI/EXEC and Batched Ingest ---" << std::endl;
+        
+        // Test a transaction: commands are queued, then run together
+        std::cout << "Testing MULTI/EXEC..." << std::endl;
+        std::string multi_response = sendPipeline("MULTI\nXADD txstream * field value\nXLEN txstream\nEXEC", 7);
+        std::cout << "MULTI/EXEC response: " << multi_response << std::endl;
+        
+        // Test that an unknown command aborts the transaction
+        std::cout << "Testing EXECABORT..." << std::endl;
+        std::string abort_response = sendPipeline("MULTI\nUNKNOWNCOMMAND\nEXEC", 3);
+        std::cout << "EXECABORT response: " << abort_response << std::endl;
+        
+        // Test that subscription commands are refused inside a transaction
+        std::cout << "Testing XSUBSCRIBE inside MULTI..." << std::endl;
+        std::string subscribe_response = sendPipeline("MULTI\nXSUBSCRIBE txsub\nXUNSUBSCRIBE\nEXEC\nPING", 5);
+        bool refused = subscribe_response.find("-ERR XSUBSCRIBE is not allowed inside a transaction\r\n") != std::string::npos &&
+                       subscribe_response.find("-ERR XUNSUBSCRIBE is not allowed inside a transaction\r\n") != std::string::npos &&
+                       subscribe_response.find("-EXECABORT") != std::string::npos &&
+                       subscribe_response.find("+PONG\r\n") != std::string::npos;
+        std::cout << "XSUBSCRIBE/XUNSUBSCRIBE refused and EXEC aborted (expected yes): " << (refused ? "yes" : "no") << std::endl;
+        
+        // Test DISCARD and EXEC without MULTI
+        std::cout << "Testing DISCARD..." << std::endl;
+        std::string discard_response = sendPipeline("MULTI\nXADD txstream * field value\nDISCARD", 3);
+        std::cout << "DISCARD response: " << discard_response << std::endl;
+        std::string exec_response = sendCommand("EXEC");
+        std::cout << "EXEC without MULTI response: " << exec_response << std::endl;
+        
+        // Test bulk append: several entries, one reply
+        std::cout << "Testing XADDBATCH..." << std::endl;
+        std::string batch_response = sendCommand("XADDBATCH txstream * 1 event login * 2 event click page home");
+        std::cout << "XADDBATCH response: " << batch_response << std::endl;
+        std::string xlen_response = sendCommand("XLEN txstream");
+        std::cout << "XLEN after batch response (expected 3): " << xlen_response << std::endl;
+        std::string invalid_batch_response = sendCommand("XADDBATCH txstream * 2 event login");
+        std::cout << "Invalid XADDBATCH response: " << invalid_batch_response << std::endl;
+    }
+    
+    void testSubscriptions() {
+        std::cout << "\n--- Testing RESP3 Push Subscriptions ---" << std::endl;
+        
+        // Test protocol negotiation
+        std::cout << "Testing HELLO 3..." << std::endl;
+        std::string hello_response = sendPipeline("HELLO 3", 19);
+        std::cout << "HELLO 3 response: " << hello_response << std::endl;
+        
+        // Test subscribing, then receiving a new entry as a push frame
+        std::cout << "Testing XSUBSCRIBE..." << std::endl;
+        std::string subscribe_response = sendPipeline("XSUBSCRIBE pushstream", 5);
+        std::cout << "XSUBSCRIBE response: " << subscribe_response << std::endl;
+        std::string push_response = sendPipeline("XADD pushstream * field value", 16);
+        std::cout << "XADD reply and push frame: " << push_response << std::endl;
+        
+        // Test unsubscribing and switching back to RESP2
+        std::cout << "Testing XUNSUBSCRIBE..." << std::endl;
+        std::string unsubscribe_response = sendPipeline("XUNSUBSCRIBE", 5);
+        std::cout << "XUNSUBSCRIBE response: " << unsubscribe_response << std::endl;
+        std::string hello2_response = sendPipeline("HELLO 2", 19);
+        std::cout << "HELLO 2 response: " << hello2_response << std::endl;
+        std::string noproto_response = sendCommand("HELLO 4");
+        std::cout << "HELLO 4 response: " << noproto_response << std::endl;
+    }
+    
+    void testIndex() {
+        std::cout << "\n--- Testing Secondary Field Index ---" << std::endl;
+        
+        sendCommand("XADD indexstream 1-0 device_id d1 temp 20");
+        sendCommand("XADD indexstream 2-0 device_id d2 temp 21");
+        
+        // Test creating an index over existing entries, then adding more
+        std::cout << "Testing XINDEX CREATE..." << std::endl;
+        std::string create_response = sendCommand("XINDEX CREATE indexstream device_id");
+        std::cout << "XINDEX CREATE response: " << create_response << std::endl;
+        sendCommand("XADD indexstream 3-0 device_id d1 temp 22");
+        sendCommand("XADD indexstream 4-0 device_id d1 temp 23");
+        
+        // Test querying with COUNT paging
+        std::cout << "Testing XQUERY..." << std::endl;
+        std::string query_response = sendCommand("XQUERY indexstream device_id d1");
+        std::cout << "XQUERY response: " << query_response << std::endl;
+        std::string page_response = sendCommand("XQUERY indexstream device_id d1 AFTER 1-0 COUNT 1");
+        std::cout << "XQUERY AFTER 1-0 COUNT 1 response: " << page_response << std::endl;
+        
+        // Test that deleted and trimmed entries leave the index
+        std::cout << "Testing index maintenance..." << std::endl;
+        sendCommand("XDEL indexstream 3-0");
+        sendCommand("XTRIM indexstream MAXLEN 2");
+        std::string after_trim_response = sendCommand("XQUERY indexstream device_id d1");
+        std::cout << "XQUERY after XDEL/XTRIM response (expected 4-0 only): " << after_trim_response << std::endl;
+        
+        // Test that paging stays exact when an append with a lower ID is
+        // refused rather than stored behind a newer posting
+        std::cout << "Testing XQUERY AFTER around an out-of-order ID..." << std::endl;
+        std::string stale_response = sendCommand("XADD indexstream 3-5 device_id d1 temp 24");
+        std::cout << "XADD 3-5 after 4-0 response: " << stale_response << std::endl;
+        sendCommand("XADD indexstream 5-0 device_id d1 temp 25");
+        std::string paged_response = sendCommand("XQUERY indexstream device_id d1 AFTER 4-0");
+        std::cout << "XQUERY AFTER 4-0 response (expected 5-0 only): " << paged_response << std::endl;
+        
+        std::string unindexed_response = sendCommand("XQUERY indexstream temp 20");
+        std::cout << "XQUERY on unindexed field response: " << unindexed_response << std::endl;
+    }
+    
+    void testKeyspace() {
+        std::cout << "\n--- Testing Keyspace Commands ---" << std::endl;
+        
+        sendCommand("XADD ks:a * f v");
+        sendCommand("XADD ks:b * f v");
+        sendCommand("XADD ks:c * f v");
+        
+        // Test EXISTS and TYPE
+        std::cout << "Testing EXISTS and TYPE..." << std::endl;
+        std::string exists_response = sendCommand("EXISTS ks:a ks:b ks:missing");
+        std::cout << "EXISTS ks:a ks:b ks:missing response (expected 2): " << exists_response << std::endl;
+        std::string type_response = sendCommand("TYPE ks:a");
+        std::cout << "TYPE ks:a response: " << type_response << std::endl;
+        std::string type_missing_response = sendCommand("TYPE ks:missing");
+        std::cout << "TYPE ks:missing response: " << type_missing_response << std::endl;
+        
+        // Test KEYS and a full SCAN with MATCH
+        std::cout << "Testing KEYS and SCAN..." << std::endl;
+        std::string keys_response = sendCommand("KEYS ks:[ab]");
+        std::cout << "KEYS ks:[ab] response: " << keys_response << std::endl;
+        std::string scan_response = sendCommand("SCAN 0 MATCH ks:* COUNT 1000");
+        std::cout << "SCAN 0 MATCH ks:* COUNT 1000 response: " << scan_response << std::endl;
+        
+        // Test DEL, then recreating a deleted key
+        std::cout << "Testing DEL..." << std::endl;
+        std::string del_response = sendCommand("DEL ks:a ks:b ks:missing");
+        std::cout << "DEL ks:a ks:b ks:missing response (expected 2): " << del_response << std::endl;
+        sendCommand("XADD ks:a * f v2");
+        std::string recreated_response = sendCommand("XLEN ks:a");
+        std::cout << "XLEN of recreated ks:a response (expected 1): " << recreated_response << std::endl;
+    }
+    
+    void testPartitions() {
+        std::cout << "\n--- Testing Partitioned Streams ---" << std::endl;
+        
+        // Test creating a partitioned stream
+        std::cout << "Testing XPCREATE..." << std::endl;
+        std::string create_response = sendCommand("XPCREATE pstream 3");
+        std::cout << "XPCREATE pstream 3 response: " << create_response << std::endl;
+        std::string exists_response = sendCommand("XPCREATE pstream 3");
+        std::cout << "XPCREATE on existing key response: " << exists_response << std::endl;
+        
+        // Test appends spread round robin over the partitions
+        std::cout << "Testing XPADD and XADD on a partitioned stream..." << std::endl;
+        sendCommand("XPADD pstream 1-0 n 1");
+        sendCommand("XPADD pstream 2-0 n 2");
+        sendCommand("XADD pstream 3-0 n 3");
+        sendCommand("XPADD pstream 4-0 n 4");
+        std::string stale_response = sendCommand("XPADD pstream 4-0 n 5");
+        std::cout << "XPADD with a stale ID response: " << stale_response << std::endl;
+        std::string len_response = sendCommand("XLEN pstream");
+        std::cout << "XLEN pstream response (expected 4): " << len_response << std::endl;
+        
+        // Test merged reads come back in global ID order
+        std::cout << "Testing merged XRANGE and XREAD..." << std::endl;
+        std::string range_response = sendCommand("XRANGE pstream - + COUNT 3");
+        std::cout << "XRANGE pstream - + COUNT 3 response (expected 1-0, 2-0, 3-0): " << range_response << std::endl;
+        std::string read_response = sendCommand("XREAD STREAMS pstream 2-0");
+        std::cout << "XREAD STREAMS pstream 2-0 response (expected 3-0, 4-0): " << read_response << std::endl;
+        
+        std::string info_response = sendCommand("XINFO STREAM pstream");
+        std::cout << "XINFO STREAM pstream response: " << info_response << std::endl;
+        std::string xdel_response = sendCommand("XDEL pstream 1-0");
+        std::cout << "XDEL on a partitioned stream response: " << xdel_response << std::endl;
+        
+        // Test that subscribers are pushed entries from every partition
+        std::cout << "Testing XSUBSCRIBE on a partitioned stream..." << std::endl;
+        sendPipeline("HELLO 3", 19);
+        std::string psubscribe_response = sendPipeline("XSUBSCRIBE pstream", 5);
+        std::cout << "XSUBSCRIBE pstream response: " << psubscribe_response << std::endl;
+        std::string ppush_response = sendPipeline("XPADD pstream 5-0 n 5", 16);
+        std::cout << "XPADD reply and push frame (expected 5-0 only): " << ppush_response << std::endl;
+        sendPipeline("XUNSUBSCRIBE", 5);
+        sendPipeline("HELLO 2", 19);
+    }
+    
+    void testLargeValues() {
+        std::cout << "\n--- Testing Large Values ---" << std::endl;
+        
+        // Test a value large enough to be stored in a shared buffer
+        std::cout << "Testing XADD with a 600-byte value..." << std::endl;
+        std::string big(600, 'v');
+        std::string add_response = sendCommand("XADD bigstream 1-0 small s big " + big);
+        std::cout << "XADD bigstream response: " << add_response << std::endl;
+        
+        // Test the reply carries the value intact between the small fields
+        std::cout << "Testing XRANGE returns the value intact..." << std::endl;
+        std::string range_response = sendCommand("XRANGE bigstream - +");
+        bool intact = range_response.find("$600\r\n" + big + "\r\n") != std::string::npos &&
+                      range_response.find("$5\r\nsmall\r\n$1\r\ns\r\n") != std::string::npos;
+        std::cout << "XRANGE bigstream value intact (expected yes): " << (intact ? "yes" : "no") << std::endl;
+        std::string usage_response = sendCommand("MEMORY USAGE bigstream");
+        std::cout << "MEMORY USAGE bigstream response: " << usage_response << std::endl;
+    }
+    
+    void testCapture() {
+        std::cout << "\n--- Testing Traffic Capture ---" << std::endl;
+        
+        // Captures are created in the server's capture-dir
+        std::string dir_response = sendCommand("CONFIG GET capture-dir");
+        std::cout << "CONFIG GET capture-dir response: " << dir_response << std::endl;
+        size_t dir_end = dir_response.rfind("\r\n");
+        size_t dir_start = dir_response.rfind("\r\n", dir_end - 1) + 2;
+        std::string dir = dir_response.substr(dir_start, dir_end - dir_start);
+        std::string name = "testbench_capture_" + std::to_string(getpid()) + ".bin";
+        std::string path = dir + "/" + name;
+        
+        // Test starting a capture
+        std::cout << "Testing CONFIG SET capture-file..." << std::endl;
+        std::string start_response = sendCommand("CONFIG SET capture-file " + name);
+        std::cout << "CONFIG SET capture-file response: " << start_response << std::endl;
+        std::string get_response = sendCommand("CONFIG GET capture-file");
+        std::cout << "CONFIG GET capture-file response: " << get_response << std::endl;
+        sendCommand("XADD capturestream 1-0 field captured");
+        
+        // Test stopping it; an empty value needs the RESP form
+        std::cout << "Testing CONFIG SET capture-file to empty stops the capture..." << std::endl;
+        std::string stop_response = sendCommand("*4\r\n$6\r\nCONFIG\r\n$3\r\nSET\r\n$12\r\ncapture-file\r\n$0\r\n\r");
+        std::cout << "CONFIG SET capture-file \"\" response: " << stop_response << std::endl;
+        
+        // Test the file holds the header and the recorded command
+        std::string data;
+        FILE* f = fopen(path.c_str(), "rb");
+        if (f) {
+            char buffer[4096];
+            size_t n;
+            while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+                data.append(buffer, n);
+            }
+            fclose(f);
+        }
+        bool recorded = data.compare(0, 8, "RSCAP01\n") == 0 && data.find("captured") != std::string::npos;
+        std::cout << "Capture file holds the command (expected yes): " << (recorded ? "yes" : "no") << std::endl;
+        
+        // Test an existing file is never overwritten
+        std::cout << "Testing CONFIG SET capture-file with an existing file..." << std::endl;
+        std::string existing_response = sendCommand("CONFIG SET capture-file " + name);
+        std::cout << "CONFIG SET capture-file existing file response: " << existing_response << std::endl;
+        unlink(path.c_str());
+        
+        // Test paths outside capture-dir are rejected
+        std::cout << "Testing CONFIG SET capture-file with a path..." << std::endl;
+        std::string bad_response = sendCommand("CONFIG SET capture-file /tmp/capture.bin");
+        std::cout << "CONFIG SET capture-file path response: " << bad_response << std::endl;
+        std::string dir_set_response = sendCommand("CONFIG SET capture-dir /tmp");
+        std::cout << "CONFIG SET capture-dir response: " << dir_set_response << std::endl;
+    }
+    
+    void testAdmission() {
+        std::cout << "\n--- Testing Admission Control ---" << std::endl;
+        
+        // Test a connection over maxclients is refused with an error
+        std::cout << "Testing CONFIG SET maxclients 1..." << std::endl;
+        std::string maxclients_response = sendCommand("CONFIG SET maxclients 1");
+        std::cout << "CONFIG SET maxclients response: " << maxclients_response << std::endl;
+        int extra = openConnection();
+        std::string refused_response;
+        if (extra >= 0) {
+            char buffer[1024];
+            int n = read(extra, buffer, sizeof(buffer) - 1);
+            if (n > 0) refused_response.assign(buffer, n);
+            close(extra);
+        }
+        std::cout << "Second connection response: " << refused_response << std::endl;
+        sendCommand("CONFIG SET maxclients 10000");
+        
+        // Test commands over the per-client rate are rejected
+        std::cout << "Testing CONFIG SET client-command-rate 3..." << std::endl;
+        std::string rate_response = sendCommand("CONFIG SET client-command-rate 3");
+        std::cout << "CONFIG SET client-command-rate response: " << rate_response << std::endl;
+        std::string pipeline_response = sendPipeline("PING\nPING\nPING\nPING", 4);
+        std::cout << "Pipelined PINGs over the rate response: " << pipeline_response << std::endl;
+        
+        // Wait for the bucket to refill so the reset itself is let through
+        std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+        sendCommand("CONFIG SET client-command-rate 0");
+        
+        // Test a pipeline whose replies exceed client-max-inflight is held
+        // back until read, not disconnected
+        std::cout << "Testing a pipeline over client-max-inflight 1kb..." << std::endl;
+        sendCommand("CONFIG SET client-max-inflight 1kb");
+        std::string echoes;
+        for (int i = 0; i < 200; ++i) {
+            echoes += (i ? "\n" : "") + std::string("ECHO ") + std::string(100, 'e');
+        }
+        std::string echo_response = sendPipeline(echoes, 200 * 2);
+        size_t replies = 0;
+        for (size_t pos = 0; (pos = echo_response.find("$100\r\n", pos)) != std::string::npos; ++pos) {
+            replies++;
+        }
+        std::cout << "Replies received (expected 200): " << replies << std::endl;
+        sendCommand("CONFIG SET client-max-inflight 0");
+        
+        // Test the listen backlog is fixed once the server is up
+        std::cout << "Testing CONFIG SET tcp-backlog..." << std::endl;
+        std::string backlog_response = sendCommand("CONFIG SET tcp-backlog 128");
+        std::cout << "CONFIG SET tcp-backlog response: " << backlog_response << std::endl;
+    }
+    
     void testEdgeCases() {
         std::cout << "\n--- Testing Edge Cases ---" << std::endl;
         
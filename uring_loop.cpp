@@ -0,0 +1,591 @@
+#include "uring_loop.h"
+#include "capture.h"
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+constexpr unsigned RING_ENTRIES = 1024;
+constexpr unsigned BUF_COUNT = 256;  // Must be a power of two
+constexpr uint16_t BUF_GROUP = 0;
+
+// user_data layout: connection id in the high bits, request kind in the low 3
+enum : uint64_t { OP_ACCEPT = 0, OP_RECV = 1, OP_SEND = 2, OP_CANCEL = 3, OP_WAKE = 4 };
+constexpr uint64_t OP_BITS = 3;
+
+static uint64_t makeUserData(uint64_t conn_id, uint64_t op) {
+    return (conn_id << OP_BITS) | op;
+}
+
+static int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int ioUringRegister(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+UringLoop::UringLoop(int listen_sock)
+    : ring_fd(-1), listen_fd(listen_sock), sq_ring(MAP_FAILED),
+      sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), cq_ring(MAP_FAILED), buf_ring(static_cast<io_uring_buf*>(MAP_FAILED)),
+      buf_pool(static_cast<char*>(MAP_FAILED)), buf_ring_tail(0) {
+    try {
+        setupRing();
+        setupBufferRing();
+        probeFeatures();
+    } catch (...) {
+        teardown();
+        throw;
+    }
+}
+
+UringLoop::~UringLoop() {
+    for (auto& kv : conns) {
+        close(kv.second->client->fd);
+    }
+    conns.clear();
+    teardown();
+}
+
+void UringLoop::teardown() {
+    if (buf_pool != MAP_FAILED) munmap(buf_pool, buf_pool_size);
+    if (buf_ring != MAP_FAILED) munmap(buf_ring, buf_ring_size);
+    if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+    if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+    if (ring_fd >= 0) close(ring_fd);
+}
+
+void UringLoop::setupRing() {
+    // Multishot recv can post many completions per submission, so give the
+    // completion queue more room than the submission queue
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL;
+    params.cq_entries = RING_ENTRIES * 4;
+
+    ring_fd = ioUringSetup(RING_ENTRIES, &params);
+    if (ring_fd < 0 && errno == EINVAL) {
+        // Older kernel: retry without the optional flags
+        std::memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = RING_ENTRIES * 4;
+        ring_fd = ioUringSetup(RING_ENTRIES, &params);
+    }
+    if (ring_fd < 0) {
+        throw std::runtime_error(std::string("io_uring_setup: ") + std::strerror(errno));
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) throw std::runtime_error("mmap of submission ring failed");
+
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) throw std::runtime_error("mmap of completion ring failed");
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqe_mem = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring_fd, IORING_OFF_SQES);
+    if (sqe_mem == MAP_FAILED) throw std::runtime_error("mmap of submission entries failed");
+    sqes = static_cast<io_uring_sqe*>(sqe_mem);
+
+    char* sq = static_cast<char*>(sq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    sq_local_tail = *sq_tail;
+
+    char* cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+void UringLoop::setupBufferRing() {
+    buf_ring_size = BUF_COUNT * sizeof(io_uring_buf);
+    void* ring_mem = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring_mem == MAP_FAILED) throw std::runtime_error("mmap of buffer ring failed");
+    buf_ring = static_cast<io_uring_buf*>(ring_mem);
+
+    buf_pool_size = BUF_COUNT * READ_CHUNK;
+    void* pool_mem = mmap(nullptr, buf_pool_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pool_mem == MAP_FAILED) throw std::runtime_error("mmap of buffer pool failed");
+    buf_pool = static_cast<char*>(pool_mem);
+
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if (ioUringRegister(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        throw std::runtime_error(std::string("buffer ring registration: ") + std::strerror(errno));
+    }
+
+    for (unsigned bid = 0; bid < BUF_COUNT; ++bid) {
+        recycleBuffer(static_cast<uint16_t>(bid));
+    }
+}
+
+// A kernel can accept the ring and the buffer ring yet reject, request by
+// request, the multishot recv (6.0) or the cancel by fd (5.19) every client
+// relies on. Check the opcodes, then try both on a socketpair, so such a
+// kernel fails here and the server falls back to epoll.
+void UringLoop::probeFeatures() {
+    std::vector<char> probe_mem(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_mem.data());
+    if (ioUringRegister(ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        throw std::runtime_error(std::string("opcode probe: ") + std::strerror(errno));
+    }
+    for (unsigned op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_POLL_ADD,
+                        IORING_OP_ASYNC_CANCEL}) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            throw std::runtime_error("opcode " + std::to_string(op) + " not supported");
+        }
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        throw std::runtime_error(std::string("socketpair: ") + std::strerror(errno));
+    }
+
+    // Completions are handled here, before run() starts dispatching them
+    auto nextCompletion = [this]() {
+        while (*cq_head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            submit(1);
+        }
+        io_uring_cqe cqe = cqes[*cq_head & cq_mask];
+        __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            recycleBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        return cqe;
+    };
+
+    std::string error;
+    if (write(fds[1], "x", 1) != 1) {
+        error = std::string("socketpair write: ") + std::strerror(errno);
+    } else {
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fds[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUF_GROUP;
+        sqe->user_data = makeUserData(0, OP_RECV);
+
+        io_uring_cqe recv = nextCompletion();
+        if (recv.res != 1 || !(recv.flags & IORING_CQE_F_MORE)) {
+            error = "multishot recv: " + std::string(recv.res < 0 ? std::strerror(-recv.res) : "not supported");
+        } else {
+            sqe = getSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = fds[0];
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = makeUserData(0, OP_CANCEL);
+
+            // Wait for the cancel and for the recv it ends, in either order
+            bool cancelled = false;
+            bool recv_ended = false;
+            while (!cancelled || !recv_ended) {
+                io_uring_cqe cqe = nextCompletion();
+                if ((cqe.user_data & ((1 << OP_BITS) - 1)) == OP_CANCEL) {
+                    cancelled = true;
+                    if (cqe.res < 0) {
+                        error = std::string("cancel by fd: ") + std::strerror(-cqe.res);
+                        break;
+                    }
+                } else if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                    recv_ended = true;
+                }
+            }
+        }
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
+
+void UringLoop::recycleBuffer(uint16_t bid) {
+    io_uring_buf& buf = buf_ring[buf_ring_tail & (BUF_COUNT - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(buf_pool + static_cast<size_t>(bid) * READ_CHUNK);
+    buf.len = READ_CHUNK;
+    buf.bid = bid;
+    ++buf_ring_tail;
+
+    // The ring tail shares storage with the first entry's reserved field
+    __atomic_store_n(&buf_ring[0].resv, buf_ring_tail, __ATOMIC_RELEASE);
+}
+
+io_uring_sqe* UringLoop::getSqe() {
+    // Queue full: push what we have to the kernel without waiting
+    if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        submit(0);
+    }
+
+    unsigned index = sq_local_tail & sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    ++sq_local_tail;
+    return sqe;
+}
+
+void UringLoop::submit(unsigned wait_for) {
+    unsigned to_submit = sq_local_tail - *sq_tail;
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+    unsigned flags = wait_for > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (ioUringEnter(ring_fd, to_submit, wait_for, flags) < 0) {
+        if (errno == EINTR) {
+            to_submit = 0;  // Submissions may already have been consumed
+            continue;
+        }
+        if (errno == EAGAIN || errno == EBUSY) {
+            // Completion queue is backed up; the caller drains it next
+            return;
+        }
+        throw std::runtime_error(std::string("io_uring_enter: ") + std::strerror(errno));
+    }
+}
+
+void UringLoop::armAccept() {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = makeUserData(0, OP_ACCEPT);
+}
+
+void UringLoop::armWake() {
+    // Multishot poll: one completion each time a writer rings the mailbox
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = mailbox.fd();
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = makeUserData(0, OP_WAKE);
+}
+
+void UringLoop::armRecv(Conn& conn) {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn.client->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = makeUserData(conn.id, OP_RECV);
+    conn.inflight++;
+    conn.recv_armed = true;
+    conn.recv_cancelled = false;
+}
+
+// Cancel the recv while the client's commands are held back, and re-arm it
+// once they can run. Data the kernel already received still completes.
+void UringLoop::updateReading(Conn& conn) {
+    if (conn.closing) return;
+
+    bool pause = readPaused(*conn.client);
+    if (pause && conn.recv_armed && !conn.recv_cancelled) {
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = makeUserData(conn.id, OP_RECV);
+        sqe->user_data = makeUserData(conn.id, OP_CANCEL);
+        conn.inflight++;
+        conn.recv_cancelled = true;
+    } else if (!pause && !conn.recv_armed) {
+        armRecv(conn);
+    }
+}
+
+void UringLoop::queueSend(Conn& conn) {
+    Client& c = *conn.client;
+    int count = c.reply.fillIovecs(conn.iov, MAX_SEND_IOV);
+
+    std::memset(&conn.msg, 0, sizeof(conn.msg));
+    conn.msg.msg_iov = conn.iov;
+    conn.msg.msg_iovlen = count;
+
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = c.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&conn.msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = makeUserData(conn.id, OP_SEND);
+    conn.send_inflight = true;
+    conn.inflight++;
+}
+
+void UringLoop::queueOutput(Conn& conn) {
+    if (!conn.output_queued) {
+        conn.output_queued = true;
+        pending_output.push_back(conn.id);
+    }
+}
+
+void UringLoop::run() {
+    armAccept();
+    armWake();
+
+    while (true) {
+        submit(1);
+        load.batchStarted();
+
+        // Drain every completion that is ready before submitting again
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            io_uring_cqe cqe = cqes[head & cq_mask];
+            ++head;
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            handleCompletion(cqe);
+            if (head == tail) {
+                tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            }
+        }
+
+        flushPendingOutput();
+        load.batchFinished();
+    }
+}
+
+void UringLoop::handleCompletion(const io_uring_cqe& cqe) {
+    uint64_t op = cqe.user_data & ((1 << OP_BITS) - 1);
+    uint64_t conn_id = cqe.user_data >> OP_BITS;
+
+    if (op == OP_ACCEPT) {
+        onAccept(cqe);
+        return;
+    }
+    if (op == OP_WAKE) {
+        onWake(cqe);
+        return;
+    }
+
+    auto it = conns.find(conn_id);
+    if (it == conns.end()) {
+        // Only possible for receive buffers: hand them back regardless
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            recycleBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        return;
+    }
+    Conn& conn = *it->second;
+
+    switch (op) {
+        case OP_RECV:
+            onRecv(conn, cqe);
+            break;
+        case OP_SEND:
+            onSend(conn, cqe.res);
+            break;
+        case OP_CANCEL:
+            conn.inflight--;
+            releaseIfIdle(conn);
+            break;
+    }
+}
+
+void UringLoop::onAccept(const io_uring_cqe& cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        armAccept();
+    }
+    if (cqe.res < 0) {
+        if (cqe.res != -EAGAIN && cqe.res != -EINTR && cqe.res != -ECANCELED) {
+            std::cerr << "Accept failed: " << std::strerror(-cqe.res) << std::endl;
+        }
+        return;
+    }
+
+    int client_sock = cqe.res;
+    if (!admitClient(client_sock, load)) return;
+
+    int opt = 1;
+    setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    sockaddr_in client_addr;
+    socklen_t client_len = sizeof(client_addr);
+    std::string addr = "?";
+    if (getpeername(client_sock, (sockaddr*)&client_addr, &client_len) == 0) {
+        char client_ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &(client_addr.sin_addr), client_ip, INET_ADDRSTRLEN);
+        addr = std::string(client_ip) + ":" + std::to_string(ntohs(client_addr.sin_port));
+    }
+
+    std::unique_ptr<Conn> conn(new Conn());
+    conn->client.reset(new Client(client_sock, addr));
+    conn->client->mailbox = &mailbox;
+    conn->client->load = &load;
+    conn->id = conn->client->id;
+    conn->inflight = 0;
+    conn->recv_armed = false;
+    conn->recv_cancelled = false;
+    conn->send_inflight = false;
+    conn->output_queued = false;
+    conn->closing = false;
+
+    Conn& ref = *conn;
+    conns[ref.id] = std::move(conn);
+    std::cout << "Client connected: " << addr << std::endl;
+    armRecv(ref);
+}
+
+void UringLoop::onWake(const io_uring_cqe& cqe) {
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        armWake();
+    }
+
+    for (Client* c : mailbox.deliver()) {
+        auto it = conns.find(c->id);
+        if (it != conns.end()) {
+            queueOutput(*it->second);
+        }
+    }
+}
+
+void UringLoop::onRecv(Conn& conn, const io_uring_cqe& cqe) {
+    Client& c = *conn.client;
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (!more) {
+        conn.inflight--;
+        conn.recv_armed = false;
+    }
+
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        if (cqe.res > 0 && !conn.closing) {
+            c.querybuf.append(buf_pool + static_cast<size_t>(bid) * READ_CHUNK, cqe.res);
+        }
+        recycleBuffer(bid);
+    }
+
+    if (conn.closing) {
+        releaseIfIdle(conn);
+        return;
+    }
+
+    if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)) {
+        closeConn(conn);  // EOF or socket error
+        return;
+    }
+    if (cqe.res < 0) {
+        // Buffer ring ran dry, the kernel ended the multishot, or we paused
+        // reading: re-arm unless still paused
+        updateReading(conn);
+        return;
+    }
+
+    if (!checkQueryBufferLimits(c)) {
+        closeConn(conn);
+        return;
+    }
+
+    processInputBuffer(c);
+    updateReading(conn);
+    queueOutput(conn);
+}
+
+void UringLoop::onSend(Conn& conn, int res) {
+    conn.send_inflight = false;
+    conn.inflight--;
+
+    if (conn.closing) {
+        releaseIfIdle(conn);
+        return;
+    }
+    if (res < 0) {
+        closeConn(conn);
+        return;
+    }
+
+    conn.client->reply.consume(static_cast<size_t>(res));
+    checkOutputBufferLimits(*conn.client);
+    resumeClient(*conn.client);
+    updateReading(conn);
+    queueOutput(conn);
+}
+
+void UringLoop::flushPendingOutput() {
+    std::vector<uint64_t> ids;
+    ids.swap(pending_output);
+
+    for (uint64_t id : ids) {
+        auto it = conns.find(id);
+        if (it == conns.end()) continue;
+        Conn& conn = *it->second;
+        Client& c = *conn.client;
+        conn.output_queued = false;
+
+        if (conn.closing || conn.send_inflight) continue;
+
+        if (c.close_asap) {
+            closeConn(conn);
+        } else if (!c.reply.empty()) {
+            queueSend(conn);
+        } else if (c.close_after_reply) {
+            closeConn(conn);
+        }
+    }
+}
+
+void UringLoop::closeConn(Conn& conn) {
+    if (conn.closing) return;
+    conn.closing = true;
+    unsubscribeAll(*conn.client);
+    if (capture_enabled.load(std::memory_order_relaxed)) {
+        captureDisconnect(conn.client->id);
+    }
+
+    if (conn.inflight > 0) {
+        // Cancel the armed recv (and any send) on this fd; the completions
+        // that follow bring inflight back to zero
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = conn.client->fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = makeUserData(conn.id, OP_CANCEL);
+        conn.inflight++;
+    }
+    releaseIfIdle(conn);
+}
+
+void UringLoop::releaseIfIdle(Conn& conn) {
+    if (!conn.closing || conn.inflight > 0) return;
+
+    close(conn.client->fd);
+    std::cout << "Client connection closed: " << conn.client->addr << std::endl;
+    conns.erase(conn.id);
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "event_loop.h"
+#include "networking.h"
+#include "pubsub.h"
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <map>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// Completion-based backend on raw io_uring. A multishot accept and one
+// multishot recv per client stay armed across completions, receives land in
+// a provided buffer ring registered with the kernel, and every request
+// queued while handling a batch of completions goes out with the same
+// io_uring_enter that waits for the next batch. A pipelined client therefore
+// costs one syscall per batch rather than a read and a write per command.
+class UringLoop : public EventLoop {
+public:
+    explicit UringLoop(int listen_fd);
+    ~UringLoop() override;
+
+    void run() override;
+
+private:
+    static constexpr int MAX_SEND_IOV = 64;
+
+    // A client plus the io_uring requests it has outstanding
+    struct Conn {
+        uint64_t id;  // Same as the client's id
+        std::unique_ptr<Client> client;
+        int inflight;  // Requests that will still produce a completion
+        bool recv_armed;  // The multishot recv hasn't posted its last completion
+        bool recv_cancelled;  // And we asked for it to stop: see readPaused()
+        bool send_inflight;  // At most one send at a time keeps replies ordered
+        bool output_queued;  // Already listed in pending_output
+        bool closing;
+        msghdr msg;  // Referenced by the kernel until the send completes
+        iovec iov[MAX_SEND_IOV];
+    };
+
+    int ring_fd;
+    int listen_fd;
+
+    // Submission queue
+    void* sq_ring;
+    size_t sq_ring_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;  // Tail we have filled up to, not yet published
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    // Completion queue
+    void* cq_ring;
+    size_t cq_ring_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe* cqes;
+
+    // Provided receive buffers
+    io_uring_buf* buf_ring;
+    size_t buf_ring_size;
+    char* buf_pool;
+    size_t buf_pool_size;
+    uint16_t buf_ring_tail;
+
+    std::map<uint64_t, std::unique_ptr<Conn>> conns;
+    std::vector<uint64_t> pending_output;  // Conns with replies to send
+    PushMailbox mailbox;  // New entries for streams our clients tail
+    LoadMonitor load;  // Queue delay, for load shedding
+
+    void setupRing();
+    void setupBufferRing();
+    void probeFeatures();
+    void teardown();  // Unmap and close whatever setup managed to create
+
+    io_uring_sqe* getSqe();
+    void submit(unsigned wait_for);
+
+    void armAccept();
+    void armWake();
+    void armRecv(Conn& conn);
+    void updateReading(Conn& conn);
+    void queueSend(Conn& conn);
+    void queueOutput(Conn& conn);
+    void recycleBuffer(uint16_t bid);
+
+    void handleCompletion(const io_uring_cqe& cqe);
+    void onAccept(const io_uring_cqe& cqe);
+    void onWake(const io_uring_cqe& cqe);
+    void onRecv(Conn& conn, const io_uring_cqe& cqe);
+    void onSend(Conn& conn, int res);
+
+    // Flush replies produced by the last batch of completions
+    void flushPendingOutput();
+
+    // Cancel outstanding requests; the fd is closed once they have completed
+    void closeConn(Conn& conn);
+    void releaseIfIdle(Conn& conn);
+};